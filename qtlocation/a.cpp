@@ -37,9 +37,11 @@
 /**************************************************************************************************/
 
 #include "map_gesture_area.h"
+#include "map_gesture_trace.h"
 #include "qtcarto.h"
 
 #include "declarative_map_item.h"
+#include "map_gesture_recorder.h"
 
 #include <cmath>
 
@@ -309,40 +311,29 @@ constexpr qreal MAXIMUM_PRESS_AND_HOLD_JITTER = 30.;
 constexpr qint64 MINIMUM_DOUBLE_PRESS_TIME = 10; // [ms]
 constexpr qint64 MAXIMUM_DOUBLE_PRESS_TIME = 300; // [ms]
 
-constexpr int QML_MAP_FLICK_VELOCITY_SAMPLE_PERIOD = 50; // [s]
-
 // FlickThreshold determines how far the "mouse" must have moved before we perform a flick.
 constexpr int FLICK_THRESHOLD = 20; // [px]
 
 // Really slow flicks can be annoying.
 constexpr qreal MINIMUM_FLICK_VELOCITY = 75.0; // [px/s]
 
+constexpr qreal MINIMUM_ZOOM_INERTIA_RATE = .5; // [zoom level/s]
+constexpr qreal MAXIMUM_ZOOM_INERTIA_RATE = 8.; // [zoom level/s]
+
 /**************************************************************************************************/
 
-QMouseEvent *
-copy_mouse_event(const QMouseEvent * event)
+static QcVectorDouble
+coordinate_to_mercator(const QcWgsCoordinate & coordinate)
 {
-  return new QMouseEvent(QEvent::MouseButtonPress,
-                         event->pos(),
-                         event->button(), event->buttons(),
-                         event->modifiers());
+  return QcKineticScroller::wgs84_to_mercator(coordinate.longitude(), coordinate.latitude());
 }
 
-QTouchEvent::TouchPoint *
-create_touch_point_from_mouse_event(const QMouseEvent * event, Qt::TouchPointState state)
+static QcWgsCoordinate
+mercator_to_coordinate(const QcVectorDouble & mercator)
 {
-  qQCInfo();
-
-  // this is only partially filled. But since it is only partially used it works
-  // more robust would be to store a list of QPointFs rather than TouchPoints
-
-  QTouchEvent::TouchPoint * new_point = new QTouchEvent::TouchPoint();
-  //qt6 new_point->setPos(event->position()); // relative to the item
-  //qt6 new_point->setScenePos(event->scenePosition()); // relative to the window
-  //qt6 new_point->setScreenPos(event->globalPosition()); // relative to the screen
-  //qt6 new_point->setState(state);
-  //qt6 new_point->setId(0);
-  return new_point;
+  // wrap around the antimeridian
+  QcVectorDouble coordinate = QcKineticScroller::mercator_to_wgs84(QcVectorDouble(mercator.x() - std::floor(mercator.x()), mercator.y()));
+  return QcWgsCoordinate(coordinate.x(), coordinate.y());
 }
 
 /**************************************************************************************************/
@@ -352,25 +343,31 @@ QcMapGestureArea::QcMapGestureArea(QcMapItem * map)
     m_map(map),
     m_enabled(true),
     m_accepted_gestures(PinchGesture | PanGesture | FlickGesture),
+    m_statistics(),
+    m_statistics_object(new QcGestureStatisticsObject(&m_statistics, this)),
     m_prevent_stealing(false),
-    m_pan_enabled(true)
+    m_pan_enabled(true),
+    m_update_mode(ImmediateUpdate),
+    m_update_pending(false),
+    m_recorder(nullptr),
+    m_trace_buffer(nullptr)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   m_flick.m_enabled = true;
   m_flick.m_max_velocity = QML_MAP_FLICK_DEFAULT_MAX_VELOCITY;
   m_flick.m_deceleration = QML_MAP_FLICK_DEFAULT_DECELERATION;
 
-  m_flick.m_animation = new QcGeoCoordinateAnimation(this);
-  m_flick.m_animation->setTargetObject(m_map);
-  m_flick.m_animation->setProperty(QStringLiteral("center"));
-  m_flick.m_animation->setEasing(QEasingCurve(QEasingCurve::OutQuad));
-  connect(m_flick.m_animation, &QQuickAbstractAnimation::stopped,
-          this, &QcMapGestureArea::handle_flick_animation_stopped);
+  m_flick.m_scroller = new QcKineticScroller(this);
+  connect(m_flick.m_scroller, &QcKineticScroller::updated,
+          this, &QcMapGestureArea::handle_scroller_updated);
+  connect(m_flick.m_scroller, &QcKineticScroller::channels_finished,
+          this, &QcMapGestureArea::handle_scroller_finished);
 
   m_touch_point_state = TouchPoints0;
   m_pinch_state = PinchInactive;
   m_flick_state = FlickInactive;
+  m_input_timestamp = 0;
 
   m_press_timer.setSingleShot(true);
   m_press_timer.setInterval(MINIMUM_PRESS_AND_HOLD_TIME);
@@ -379,6 +376,10 @@ QcMapGestureArea::QcMapGestureArea(QcMapItem * map)
 
   m_press_time.invalidate();
   m_double_press_time.invalidate();
+
+  m_resample_timer.setSingleShot(true);
+  connect(&m_resample_timer, &QTimer::timeout,
+          this, &QcMapGestureArea::handle_resample_timer_timeout);
 }
 
 QcMapGestureArea::~QcMapGestureArea()
@@ -403,7 +404,7 @@ QcMapGestureArea::~QcMapGestureArea()
 
 void QcMapGestureArea::set_prevent_stealing(bool prevent)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if (prevent != m_prevent_stealing) {
     m_prevent_stealing = prevent;
@@ -413,6 +414,55 @@ void QcMapGestureArea::set_prevent_stealing(bool prevent)
   }
 }
 
+/*!
+  \qmlproperty enumeration QtLocation::MapGestureArea::update_mode
+
+  This property holds when the gesture state machines process the input.
+
+  \list
+  \li MapGestureArea.ImmediateUpdate - Each input event runs the state machines and updates the camera (default).
+  \li MapGestureArea.FrameUpdate - Move events are accumulated and processed once per frame, just before
+      the scene graph is synchronized, so that each frame produces at most one camera update.
+      Press and release events are still processed immediately.
+  \endlist
+*/
+
+void
+QcMapGestureArea::set_update_mode(UpdateMode mode)
+{
+  qQCGestureTrace();
+
+  if (mode != m_update_mode) {
+    m_update_mode = mode;
+    // don't leave input behind when switching to the immediate mode
+    flush_pending_update();
+    emit update_modeChanged();
+  }
+}
+
+/*!
+  \qmlproperty int QtLocation::MapGestureArea::prediction_horizon
+
+  This property holds how far in the future, in milliseconds, the touch position
+  is predicted when panning.
+
+  The pan follows the touch position extrapolated to the time of the frame plus
+  this horizon, which compensates the delay between the input and the display.
+  The prediction is disabled when the input is too irregular.  A value of 0
+  disables the resampling (default).
+*/
+
+void
+QcMapGestureArea::set_prediction_horizon(int horizon)
+{
+  qQCGestureTrace();
+
+  if (horizon != m_resampler.horizon()) {
+    m_resampler.set_horizon(horizon);
+    emit prediction_horizonChanged();
+  }
+}
+
 /*!
   \qmlproperty enumeration QtLocation::MapGestureArea::acceptedGestures
 
@@ -430,7 +480,7 @@ void QcMapGestureArea::set_prevent_stealing(bool prevent)
 void
 QcMapGestureArea::set_accepted_gestures(Accepted_gestures accepted_gestures)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if (accepted_gestures != m_accepted_gestures) {
     m_accepted_gestures = accepted_gestures;
@@ -452,7 +502,7 @@ QcMapGestureArea::is_active() const
 void
 QcMapGestureArea::set_enabled(bool enabled)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if (enabled != m_enabled) {
     m_enabled = enabled;
@@ -480,7 +530,7 @@ QcMapGestureArea::is_pinch_active() const
 void
 QcMapGestureArea::set_pinch_enabled(bool enabled)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if (enabled != m_pinch.m_enabled)
     m_pinch.m_enabled = enabled;
@@ -495,7 +545,7 @@ QcMapGestureArea::is_pan_active() const
 void
 QcMapGestureArea::set_pan_enabled(bool enabled)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if (enabled != m_flick.m_enabled) {
     m_pan_enabled = enabled;
@@ -508,7 +558,7 @@ QcMapGestureArea::set_pan_enabled(bool enabled)
 void
 QcMapGestureArea::set_flick_enabled(bool enabled)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if (enabled != m_flick.m_enabled) {
     m_flick.m_enabled = enabled;
@@ -528,7 +578,7 @@ QcMapGestureArea::set_flick_enabled(bool enabled)
 void
 QcMapGestureArea::set_zoom_level_interval(const QcIntervalInt interval)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   m_pinch.m_zoom.m_interval = interval;
 }
@@ -542,7 +592,7 @@ QcMapGestureArea::maximum_zoom_level_change() const
 void
 QcMapGestureArea::set_maximum_zoom_level_change(qreal max_change)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   // Fixme: !()
   if (max_change == m_pinch.m_zoom.maximum_change or
@@ -556,7 +606,7 @@ QcMapGestureArea::set_maximum_zoom_level_change(qreal max_change)
 void
 QcMapGestureArea::set_flick_deceleration(qreal deceleration)
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   deceleration = qBound(QML_MAP_FLICK_MINIMUM_DECELERATION, deceleration, QML_MAP_FLICK_MAXIMUM_DECELERATION);
   if (deceleration != m_flick.m_deceleration) {
@@ -568,7 +618,7 @@ QcMapGestureArea::set_flick_deceleration(qreal deceleration)
 void
 QcMapGestureArea::clear_touch_data()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   // Fixme: vectorize
   m_current_position.set_x(0);
@@ -577,29 +627,44 @@ QcMapGestureArea::clear_touch_data()
   m_start_coordinate.set_longitude(0);
   m_touch_center_coordinate.set_latitude(0);
   m_touch_center_coordinate.set_longitude(0);
-  m_velocity_x = 0;
-  m_velocity_y = 0;
+  m_touch_geometry.clear();
+  m_velocity_tracker.clear();
 }
 
 void
-QcMapGestureArea::update_velocity_list(const QcVectorDouble & position)
+QcMapGestureArea::set_mouse_point(const QMouseEvent * event, QEventPoint::State state)
 {
-  qQCInfo();
-
-  // position = m_current_position
-
-  // Take velocity samples every sufficient period of time, used later to determine the flick
-  // duration and speed (when mouse is released).
+  // Overwrite the synthetic point in place, a mouse move must not allocate
+  if (!m_mouse_point)
+    m_mouse_point.emplace();
+  m_mouse_point->set(event, state);
+}
 
-  qreal elapsed = qreal(m_last_position_for_velocity_time.elapsed()); // [ms]
-  if (elapsed >= QML_MAP_FLICK_VELOCITY_SAMPLE_PERIOD) {
-    elapsed /= 1000.; // to [s]
-    QcVectorDouble velocity = (position - m_last_position_for_velocity) / elapsed; // [px/s]
-    m_last_position_for_velocity = position;
-    m_last_position_for_velocity_time.restart();
-    m_velocity_x = qBound<qreal>(-m_flick.m_max_velocity, velocity.x(), m_flick.m_max_velocity);
-    m_velocity_y = qBound<qreal>(-m_flick.m_max_velocity, velocity.y(), m_flick.m_max_velocity);
+void
+QcMapGestureArea::add_input_sample(quint64 timestamp)
+{
+  qQCGestureTrace();
+
+  // Record the centroid of the latest input with the timestamp of its event, used later to
+  // determine the flick velocity (when the mouse is released) and to resample the pan.  It is
+  // called for each move before the update is coalesced, thus the tracker and the resampler
+  // see all the samples of a frame.
+  QcVectorDouble centroid;
+  int number_of_points = 0;
+  if (!m_touch_points.isEmpty()) {
+    for (const QcTouchPoint & point : m_touch_points)
+      centroid = centroid + point.position();
+    number_of_points = m_touch_points.count();
+  } else if (m_mouse_point) {
+    centroid = m_mouse_point->position();
+    number_of_points = 1;
   }
+  if (!number_of_points)
+    return;
+  centroid = centroid * (1. / number_of_points);
+
+  m_velocity_tracker.add_sample(timestamp, centroid);
+  m_resampler.add_sample(timestamp, centroid);
 }
 
 /**************************************************************************************************/
@@ -607,14 +672,24 @@ QcMapGestureArea::update_velocity_list(const QcVectorDouble & position)
 void
 QcMapGestureArea::handle_mouse_press_event(QMouseEvent * event)
 {
-  qQCInfo() << event;
-
-  m_mouse_point.reset(create_touch_point_from_mouse_event(event, Qt::TouchPointPressed));
-  m_mouse_event.reset(copy_mouse_event(event));
+  qQCGestureTrace() << event;
+
+  m_statistics.count_event(QcGestureStatistics::MousePressEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+
+  m_input_timestamp = event->timestamp();
+  set_mouse_point(event, QEventPoint::State::Pressed);
+  m_mouse_press.m_position = event->position();
+  m_mouse_press.m_scene_position = event->scenePosition();
+  m_mouse_press.m_global_position = event->globalPosition();
+  m_mouse_press.m_button = event->button();
+  m_mouse_press.m_buttons = event->buttons();
+  m_mouse_press.m_modifiers = event->modifiers();
   m_press_timer.start();
   m_press_time.start(); // Fixme: start_one_touch_point ?
   if (m_touch_points.isEmpty()) {
-    update();
+    request_update(false);
     if (is_double_click())
       m_map->on_double_clicked(event);
   }
@@ -624,18 +699,29 @@ QcMapGestureArea::handle_mouse_press_event(QMouseEvent * event)
 void
 QcMapGestureArea::handle_mouse_move_event(QMouseEvent * event)
 {
-  qQCInfo() << event;
+  qQCGestureTrace() << event;
 
-  m_mouse_point.reset(create_touch_point_from_mouse_event(event, Qt::TouchPointMoved));
+  m_statistics.count_event(QcGestureStatistics::MouseMoveEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+
+  m_input_timestamp = event->timestamp();
+  set_mouse_point(event, QEventPoint::State::Updated);
   if (m_touch_points.isEmpty())
-    update();
+    request_update(true);
   event->accept();
 }
 
 void
 QcMapGestureArea::handle_mouse_release_event(QMouseEvent * event)
 {
-  qQCInfo() << event;
+  qQCGestureTrace() << event;
+
+  m_statistics.count_event(QcGestureStatistics::MouseReleaseEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+
+  m_input_timestamp = event->timestamp();
 
   // Fixme sanitizer: map_gesture_area.cpp:638:7: runtime error: load of value 190, which is not a valid value for type 'bool'
   if (m_was_press_and_hold) {
@@ -643,19 +729,19 @@ QcMapGestureArea::handle_mouse_release_event(QMouseEvent * event)
     m_was_press_and_hold = false;
   }
 
-  if (!m_mouse_point.isNull()) {
+  if (m_mouse_point) {
     // this looks super ugly , however is required in case we do not get synthesized MouseReleaseEvent
     // and we reset the point already in handleTouchUngrabEvent
     // Fixme: ???
-    m_mouse_point.reset(create_touch_point_from_mouse_event(event, Qt::TouchPointReleased));
+    set_mouse_point(event, QEventPoint::State::Released);
     if (m_touch_points.isEmpty()) {
-      update();
+      request_update(false);
       // if (is_press_and_hold())
       //   m_map->on_press_and_hold(event);
     }
   }
   // Reset touch point state
-  m_touch_point_state = TouchPoints0;
+  set_touch_point_state(TouchPoints0);
   m_press_time.invalidate();
   event->accept();
 }
@@ -663,11 +749,13 @@ QcMapGestureArea::handle_mouse_release_event(QMouseEvent * event)
 void
 QcMapGestureArea::handle_mouse_ungrab_event()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
-  if (m_touch_points.isEmpty() and !m_mouse_point.isNull()) {
+  m_statistics.count_event(QcGestureStatistics::UngrabEvent);
+
+  if (m_touch_points.isEmpty() and m_mouse_point) {
     m_mouse_point.reset();
-    update();
+    request_update(false);
   } else
     m_mouse_point.reset();
 }
@@ -675,58 +763,169 @@ QcMapGestureArea::handle_mouse_ungrab_event()
 void
 QcMapGestureArea::handle_touch_ungrab_event()
 {
-  qQCInfo();
+  qQCGestureTrace();
+
+  m_statistics.count_event(QcGestureStatistics::UngrabEvent);
 
   m_touch_points.clear();
   // this is needed since in some cases mouse release is not delivered
   // (second touch point brakes mouse synthesized events)
   m_mouse_point.reset();
-  update();
+  request_update(false);
 }
 
 void
 QcMapGestureArea::handle_touch_event(QTouchEvent * event)
 {
-  qQCInfo();
+  qQCGestureTrace();
+
+  m_statistics.count_event(QcGestureStatistics::TouchEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+
+  m_input_timestamp = event->timestamp();
 
+  // Fill the inline buffer in place, QEventPoint copies are not free
+  const QList<QEventPoint> & points = event->points();
   m_touch_points.clear();
-  m_touch_points.append(event->points());
-  if (event->points().count() >= 2)
+  for (const QEventPoint & point : points)
+    if (!m_touch_points.append(point))
+      break;
+  if (points.count() >= 2)
     event->accept();
   else
     // Fixme: press_and_hold, double click
     event->ignore();
-  update();
+
+  // only pure moves can be coalesced, a press or a release changes the number of points
+  bool coalescable = event->type() == QEvent::TouchUpdate and
+    !(event->touchPointStates() & (QEventPoint::State::Pressed | QEventPoint::State::Released));
+  request_update(coalescable);
 }
 
 void
 QcMapGestureArea::handle_wheel_event(QWheelEvent * event)
 {
-  qQCInfo() << event;
+  qQCGestureTrace() << event;
+
+  m_statistics.count_event(QcGestureStatistics::WheelEvent);
+  if (m_recorder)
+    m_recorder->record(event);
 
-  if (m_map)
+  if (m_map) {
+    QcWgsCoordinate center = m_map->center();
+    double zoom_level = m_map->zoom_level();
     m_map->on_wheel_event(event);
+    if (camera_changed(center, zoom_level)) {
+      m_statistics.m_camera_updates++;
+      m_statistics.add_input_latency(event->timestamp());
+    }
+  }
+}
+
+/**************************************************************************************************/
+
+// Return true if the camera moved since the center and the zoom level were read
+bool
+QcMapGestureArea::camera_changed(const QcWgsCoordinate & center, double zoom_level) const
+{
+  const QcWgsCoordinate & new_center = m_map->center();
+  return new_center.longitude() != center.longitude() or
+    new_center.latitude() != center.latitude() or
+    m_map->zoom_level() != zoom_level;
+}
+
+void
+QcMapGestureArea::set_touch_point_state(TouchPointState state)
+{
+  if (m_trace_buffer and state != m_touch_point_state)
+    m_trace_buffer->trace_transition(QcGestureTraceRecord::TouchPointMachine, m_touch_point_state, state);
+  m_touch_point_state = state;
+}
+
+void
+QcMapGestureArea::set_pinch_state(PinchState state)
+{
+  if (m_trace_buffer and state != m_pinch_state)
+    m_trace_buffer->trace_transition(QcGestureTraceRecord::PinchMachine, m_pinch_state, state);
+  m_pinch_state = state;
+}
+
+void
+QcMapGestureArea::set_flick_state(FlickState state)
+{
+  if (m_trace_buffer and state != m_flick_state)
+    m_trace_buffer->trace_transition(QcGestureTraceRecord::FlickMachine, m_flick_state, state);
+  m_flick_state = state;
 }
 
 /**************************************************************************************************/
 
+// Process the input now, or defer it to the next frame in FrameUpdate mode.
+// The point buffers always hold the latest input, thus a deferred update simply catches up
+// with all the events received since the last frame.
+void
+QcMapGestureArea::request_update(bool coalescable)
+{
+  // a press or a release restarts or ends the tracking, the state machines take the first sample
+  if (coalescable)
+    add_input_sample(m_input_timestamp);
+
+  if (coalescable and m_update_mode == FrameUpdate and window()) {
+    if (!m_update_pending) {
+      m_update_pending = true;
+      polish();
+    }
+    return;
+  }
+
+  m_update_pending = false;
+  update();
+}
+
+// Process the pending coalesced input, if any
+void
+QcMapGestureArea::flush_pending_update()
+{
+  if (!m_update_pending)
+    return;
+  m_update_pending = false;
+  update();
+}
+
+// Polish runs on the GUI thread once per frame after the frame synchronous input delivery and
+// before the map items are polished, thus the camera update issued here is visible in the same
+// frame.
+void
+QcMapGestureArea::updatePolish()
+{
+  flush_pending_update();
+}
+
 // Simplify the gestures by using a state-machine format (easy to move to a future state machine)
 void
 QcMapGestureArea::update()
 {
-  qQCInfo() << "enter" << m_touch_point_state << m_flick_state << m_pinch_state;
+  qQCGestureInfo() << "enter" << m_touch_point_state << m_flick_state << m_pinch_state;
 
   // if (!m_map)
   //   return;
 
+  QElapsedTimer update_timer;
+  update_timer.start();
+  // the map has no camera transaction, compare the camera before and after the state machines
+  QcWgsCoordinate center = m_map->center();
+  double zoom_level = m_map->zoom_level();
+
   // First state machine is for the number of touch points
 
   // combine touch with mouse event
-  m_all_points.clear();
-  m_all_points << m_touch_points;
+  m_all_points = m_touch_points;
   // any touch points but mouse point
-  if (m_all_points.isEmpty() and !m_mouse_point.isNull())
-    m_all_points << *m_mouse_point.data();
+  if (m_all_points.isEmpty() and m_mouse_point)
+    m_all_points.append(*m_mouse_point);
+  // stable order so as to detect when a finger is added or lifted
+  m_all_points.sort_by_id();
 
   touch_point_state_machine();
 
@@ -742,7 +941,23 @@ QcMapGestureArea::update()
   if (is_pan_active() or (m_enabled and m_flick.m_enabled and (m_accepted_gestures & (PanGesture | FlickGesture))))
     pan_state_machine();
 
-  qQCInfo() << "leave" << m_touch_point_state << m_flick_state << m_pinch_state;
+  // an event which didn't move the camera, e.g. a press or a move below the drag threshold,
+  // is not a camera update
+  bool camera_updated = camera_changed(center, zoom_level);
+  if (camera_updated) {
+    m_statistics.m_camera_updates++;
+    m_statistics.add_input_latency(m_input_timestamp);
+  }
+
+  if (m_trace_buffer and camera_updated) {
+    const QcWgsCoordinate & new_center = m_map->center();
+    m_trace_buffer->trace_camera(new_center.longitude(), new_center.latitude(), m_map->zoom_level(),
+                                 m_map->bearing(), m_map->tilt());
+  }
+
+  m_statistics.add_update_time(update_timer.nsecsElapsed());
+
+  qQCGestureInfo() << "leave" << m_touch_point_state << m_flick_state << m_pinch_state;
 }
 
 /**************************************************************************************************/
@@ -750,9 +965,14 @@ QcMapGestureArea::update()
 void
 QcMapGestureArea::handle_press_timer_timeout()
 {
-  qQCInfo();
+  qQCGestureTrace();
   if (is_press_and_hold()) {
-    m_map->on_press_and_hold(m_mouse_event.data());
+    // Rebuild the press event, this only happens once per press
+    QMouseEvent event(QEvent::MouseButtonPress,
+                      m_mouse_press.m_position, m_mouse_press.m_scene_position, m_mouse_press.m_global_position,
+                      m_mouse_press.m_button, m_mouse_press.m_buttons,
+                      m_mouse_press.m_modifiers);
+    m_map->on_press_and_hold(&event);
     m_was_press_and_hold = true;
   }
   m_mouse_point.reset();
@@ -761,7 +981,7 @@ QcMapGestureArea::handle_press_timer_timeout()
 bool
 QcMapGestureArea::is_press_and_hold()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   // if (!m_map)
   //   return false;
@@ -808,41 +1028,48 @@ QcMapGestureArea::is_double_click()
 void
 QcMapGestureArea::touch_point_state_machine()
 {
-  qQCInfo() << "enter" << m_touch_point_state;
+  qQCGestureInfo() << "enter" << m_touch_point_state;
 
   int number_of_points = m_all_points.count();
 
   // Transitions:
   switch (m_touch_point_state) {
   case TouchPoints0:
+    // a new contact catches the zoom inertia, the flick is handled by the pan
+    if (number_of_points >= 1)
+      m_flick.m_scroller->stop_channels(QcKineticScroller::ZoomLevel);
     if (number_of_points == 1) {
       clear_touch_data();
       start_one_touch_point();
-      m_touch_point_state = TouchPoints1;
+      set_touch_point_state(TouchPoints1);
     } else if (number_of_points >= 2) {
       clear_touch_data();
       start_two_touch_points();
-      m_touch_point_state = TouchPoints2;
+      set_touch_point_state(TouchPoints2);
     }
     break;
 
   case TouchPoints1:
     if (number_of_points == 0) {
-      m_touch_point_state = TouchPoints0;
-    } else if (number_of_points == 2) {
+      set_touch_point_state(TouchPoints0);
+    } else if (number_of_points >= 2) {
       m_touch_center_coordinate = m_map->to_coordinate(m_current_position, false);
       start_two_touch_points();
-      m_touch_point_state = TouchPoints2;
+      set_touch_point_state(TouchPoints2);
     }
     break;
 
   case TouchPoints2:
     if (number_of_points == 0) {
-      m_touch_point_state = TouchPoints0;
+      set_touch_point_state(TouchPoints0);
     } else if (number_of_points == 1) {
       m_touch_center_coordinate = m_map->to_coordinate(m_current_position, false);
       start_one_touch_point();
-      m_touch_point_state = TouchPoints1;
+      set_touch_point_state(TouchPoints1);
+    } else if (!m_touch_geometry.has_same_points(m_all_points)) {
+      // A finger was added or lifted, restart the pan from the new centroid
+      m_touch_center_coordinate = m_map->to_coordinate(m_current_position, false);
+      start_two_touch_points();
     }
     break;
   };
@@ -859,17 +1086,19 @@ QcMapGestureArea::touch_point_state_machine()
     break;
   }
 
-  qQCInfo() << "leave" << m_touch_point_state;
+  qQCGestureInfo() << "leave" << m_touch_point_state;
 }
 
 void
 QcMapGestureArea::start_one_touch_point()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   m_start_position1 = first_point().position();
-  m_last_position_for_velocity = m_start_position1;
-  m_last_position_for_velocity_time.start();
+  m_touch_geometry.clear();
+  m_velocity_tracker.clear();
+  m_velocity_tracker.add_sample(first_point().timestamp(), m_start_position1);
+  m_resampler.reset();
   QcWgsCoordinate start_coordinate = m_map->to_coordinate(m_start_position1, false);
   // Ensures a smooth transition for panning (m_start_coordinate and m_touch_center_coordinate are cleared in clear_touch_data)
   // Fixme: ???
@@ -880,23 +1109,24 @@ QcMapGestureArea::start_one_touch_point()
 void
 QcMapGestureArea::update_one_touch_point()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   m_current_position = first_point().position();
-  update_velocity_list(m_current_position);
 }
 
 void
 QcMapGestureArea::start_two_touch_points()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   m_start_position1 = first_point().position();
   m_start_position2 = second_point().position();
-  QcVectorDouble start_position = middle(m_start_position1, m_start_position2);
-  // Fixme: duplicated code, excepted middle
-  m_last_position_for_velocity = start_position;
-  m_last_position_for_velocity_time.start();
+  m_touch_geometry.update(m_all_points, [](const QcTouchPoint & point) { return point.position(); });
+  QcVectorDouble start_position = m_touch_geometry.centroid();
+  // Fixme: duplicated code, excepted centroid
+  m_velocity_tracker.clear();
+  m_velocity_tracker.add_sample(m_touch_geometry.timestamp(), start_position);
+  m_resampler.reset();
   QcWgsCoordinate start_coordinate = m_map->to_coordinate(start_position, false);
   m_start_coordinate.set_longitude(start_coordinate.longitude() + m_start_coordinate.longitude() - m_touch_center_coordinate.longitude());
   m_start_coordinate.set_latitude(start_coordinate.latitude() + m_start_coordinate.latitude() - m_touch_center_coordinate.latitude());
@@ -905,19 +1135,14 @@ QcMapGestureArea::start_two_touch_points()
 void
 QcMapGestureArea::update_two_touch_points()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
-  QcVectorDouble p1 = first_point().position();
-  QcVectorDouble p2 = second_point().position();
-  QcVectorDouble delta = p2 - p1;
-  m_distance_between_touch_points = delta.magnitude();
-  m_current_position = middle(p1, p2);
-  update_velocity_list(m_current_position);
-
-  m_two_touch_angle = delta.orientation();
-  // Fixme: required ?
-  if (m_two_touch_angle > 180)
-    m_two_touch_angle -= 360;
+  // Centroid, spread and angle over all the points, a third finger doesn't make the gesture jump
+  m_touch_geometry.update(m_all_points, [](const QcTouchPoint & point) { return point.position(); });
+  m_distance_between_touch_points = m_touch_geometry.spread();
+  m_current_position = m_touch_geometry.centroid();
+
+  m_two_touch_angle = m_touch_geometry.angle(); // in +- 180
 }
 
 /**************************************************************************************************/
@@ -925,7 +1150,7 @@ QcMapGestureArea::update_two_touch_points()
 void
 QcMapGestureArea::pinch_state_machine()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   int number_of_points = m_all_points.count();
 
@@ -938,29 +1163,29 @@ QcMapGestureArea::pinch_state_machine()
         m_map->setKeepMouseGrab(true);
         m_map->setKeepTouchGrab(true);
         start_pinch();
-        m_pinch_state = PinchActive;
+        set_pinch_state(PinchActive);
       } else {
-        m_pinch_state = PinchInactiveTwoPoints;
+        set_pinch_state(PinchInactiveTwoPoints);
       }
     }
     break;
 
   case PinchInactiveTwoPoints:
     if (number_of_points <= 1) {
-      m_pinch_state = PinchInactive;
+      set_pinch_state(PinchInactive);
     } else {
       if (can_start_pinch()) {
         m_map->setKeepMouseGrab(true);
         m_map->setKeepTouchGrab(true);
         start_pinch();
-        m_pinch_state = PinchActive;
+        set_pinch_state(PinchActive);
       }
     }
     break;
 
   case PinchActive:
     if (number_of_points <= 1) {
-      m_pinch_state = PinchInactive;
+      set_pinch_state(PinchInactive);
       m_map->setKeepMouseGrab(m_prevent_stealing);
       m_map->setKeepTouchGrab(m_prevent_stealing);
       end_pinch();
@@ -990,7 +1215,7 @@ QcMapGestureArea::pinch_state_machine()
 bool
 QcMapGestureArea::can_start_pinch()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   int number_of_points = m_all_points.count();
   const int start_drag_distance = qApp->styleHints()->startDragDistance();
@@ -1019,7 +1244,7 @@ QcMapGestureArea::can_start_pinch()
 void
 QcMapGestureArea::start_pinch()
 {
-   qQCInfo();
+  qQCGestureTrace();
 
   m_pinch.m_last_angle = m_two_touch_angle;
   m_pinch.m_last_point1 = first_point().position();
@@ -1027,12 +1252,14 @@ QcMapGestureArea::start_pinch()
   m_pinch.m_start_distance = m_distance_between_touch_points;
   m_pinch.m_zoom.m_previous = m_map->zoom_level();
   m_pinch.m_zoom.m_start = m_map->zoom_level();
+  m_pinch.m_zoom.m_velocity_tracker.clear();
+  m_pinch.m_zoom.m_velocity_tracker.add_sample(m_input_timestamp, QcVectorDouble(m_pinch.m_zoom.m_start, 0));
 }
 
 void
 QcMapGestureArea::update_pinch()
 {
-   qQCInfo();
+  qQCGestureTrace();
 
   // Calculate the new zoom level if we have distance (>= 2 touchpoints), otherwise stick with old.
   qreal new_zoom_level = m_pinch.m_zoom.m_previous;
@@ -1074,13 +1301,14 @@ QcMapGestureArea::update_pinch()
     new_zoom_level = qMin(qMax(per_pinch_minimum_zoom_level, new_zoom_level), per_pinch_maximum_zoom_level);
     m_map->set_zoom_level(new_zoom_level);
     m_pinch.m_zoom.m_previous = new_zoom_level;
+    m_pinch.m_zoom.m_velocity_tracker.add_sample(m_input_timestamp, QcVectorDouble(new_zoom_level, 0));
   }
 }
 
 void
 QcMapGestureArea::end_pinch()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   QcVectorDouble p1 = m_pinch.m_last_point1;
   QcVectorDouble p2 = m_pinch.m_last_point2;
@@ -1094,6 +1322,33 @@ QcMapGestureArea::end_pinch()
   emit pinch_finished(&m_pinch.m_event);
 
   m_pinch.m_start_distance = 0;
+
+  start_zoom_inertia();
+}
+
+void
+QcMapGestureArea::start_zoom_inertia()
+{
+  qQCGestureTrace();
+
+  // continue the zoom within the zoom interval, the tracker returns a null velocity if the
+  // fingers paused
+  qreal zoom_rate = m_pinch.m_zoom.m_velocity_tracker.velocity(m_input_timestamp).x();
+  if (!(m_accepted_gestures & PinchGesture) or qAbs(zoom_rate) <= MINIMUM_ZOOM_INERTIA_RATE)
+    return;
+
+  QcWgsCoordinate anchor = m_map->to_coordinate(m_current_position, false);
+  if (isnan(anchor.longitude())) {
+    qWarning() << "Screen coordinate are nan";
+    return;
+  }
+  // the coordinate under the fingers stays under them, as during the pinch
+  m_pinch.m_zoom.m_anchor_point = m_current_position;
+  m_pinch.m_zoom.m_anchor = coordinate_to_mercator(anchor);
+
+  zoom_rate = qBound(-MAXIMUM_ZOOM_INERTIA_RATE, zoom_rate, MAXIMUM_ZOOM_INERTIA_RATE);
+  m_flick.m_scroller->fling_zoom_level(m_map->zoom_level(), zoom_rate,
+                                       m_pinch.m_zoom.m_interval.inf(), m_pinch.m_zoom.m_interval.sup());
 }
 
 /**************************************************************************************************/
@@ -1101,7 +1356,7 @@ QcMapGestureArea::end_pinch()
 void
 QcMapGestureArea::pan_state_machine()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   int number_of_points = m_all_points.count();
   FlickState last_state = m_flick_state;
@@ -1110,19 +1365,24 @@ QcMapGestureArea::pan_state_machine()
   switch (m_flick_state) {
   case FlickInactive:
     if (can_start_pan()) {
-      qQCInfo() << "can_start_pan";
+      qQCGestureInfo() << "can_start_pan";
       // Update start_coordinate to ensure smooth start for panning when going over startDragDistance
       // Mouse pointer slides on the map until it goes over startDragDistance
       m_start_coordinate = m_map->to_coordinate(m_current_position, false);
       m_map->setKeepMouseGrab(true);
-      m_flick_state = PanActive;
+      set_flick_state(PanActive);
     }
     break;
 
   case PanActive:
     if (number_of_points == 0) {
+      // the resampled centroid is extrapolated, the map must rest under the lifted finger
+      if (m_resampler.is_enabled()) {
+        m_resample_timer.stop();
+        align_coordinate_to_point(m_start_coordinate, m_current_position);
+      }
       if (!try_start_flick()) {
-          m_flick_state = FlickInactive;
+          set_flick_state(FlickInactive);
           // mark as inactive for use by camera
           if (m_pinch_state == PinchInactive) {
             m_map->setKeepMouseGrab(m_prevent_stealing);
@@ -1130,7 +1390,7 @@ QcMapGestureArea::pan_state_machine()
           }
           emit pan_finished();
         } else {
-        m_flick_state = FlickActive;
+        set_flick_state(FlickActive);
         emit pan_finished();
         emit flick_started();
       }
@@ -1139,9 +1399,14 @@ QcMapGestureArea::pan_state_machine()
 
   case FlickActive:
     if (number_of_points > 0) { // retouched before movement ended
-      stop_flick();
+      // take over the scrolling without the stop/start cycle of the pan
+      m_flick.m_scroller->stop_channels(QcKineticScroller::Position);
+      m_statistics.m_flicks_aborted++;
+      if (m_trace_buffer)
+        m_trace_buffer->trace_flick_stop();
+      emit flick_finished();
       m_map->setKeepMouseGrab(true);
-      m_flick_state = PanActive;
+      set_flick_state(PanActive);
     }
     break;
   }
@@ -1169,7 +1434,7 @@ QcMapGestureArea::pan_state_machine()
 bool
 QcMapGestureArea::can_start_pan()
 {
-  qQCInfo() << first_point().position() << m_start_position1;
+  qQCGestureTrace() << first_point().position() << m_start_position1;
 
   if (m_all_points.count() == 0 or (m_accepted_gestures & PanGesture) == 0) // Fixme: to func ?
     return false;
@@ -1186,19 +1451,48 @@ QcMapGestureArea::can_start_pan()
 void
 QcMapGestureArea::update_pan()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   // Not used by animation/flick
   // Map follows the mouse pointer: move the map center according to delta px
   // Fixme: delta px -> delta projected coordinate -> new center
 
-  QcVectorDouble start_point = m_map->from_coordinate(m_start_coordinate, false);
-  // Fixme: start_coordinate is no longer in the viewport
-  if (isnan(start_point.x())) {
+  if (m_resampler.is_enabled()) {
+    align_coordinate_to_point(m_start_coordinate, m_resampler.resample());
+    // no more samples means that the finger paused
+    m_resample_timer.start(m_resampler.pause_interval());
+  } else
+    align_coordinate_to_point(m_start_coordinate, m_current_position);
+}
+
+// Slot
+// The finger paused, the extrapolation of the last update would overshoot, thus the map is
+// realigned to the raw centroid.
+void
+QcMapGestureArea::handle_resample_timer_timeout()
+{
+  qQCGestureTrace();
+
+  if (m_flick_state != PanActive)
+    return;
+
+  QcWgsCoordinate center = m_map->center();
+  align_coordinate_to_point(m_start_coordinate, m_current_position);
+  if (camera_changed(center, m_map->zoom_level()))
+    m_statistics.m_camera_updates++;
+}
+
+// Move the map center so that the coordinate is at the point
+void
+QcMapGestureArea::align_coordinate_to_point(const QcWgsCoordinate & coordinate, const QcVectorDouble & point)
+{
+  QcVectorDouble current_point = m_map->from_coordinate(coordinate, false);
+  // Fixme: coordinate is no longer in the viewport
+  if (isnan(current_point.x())) {
     qWarning() << "Screen coordinate are nan";
     return;
   }
-  QcVectorDouble delta = m_current_position - start_point;
+  QcVectorDouble delta = point - current_point;
   QcVectorDouble map_center_px = QcVectorDouble(m_map->width(), m_map->height()) * .5;
   QcVectorDouble map_center_point = map_center_px - delta;
   QcWgsCoordinate new_center = m_map->to_coordinate(map_center_point, false);
@@ -1208,105 +1502,111 @@ QcMapGestureArea::update_pan()
 bool
 QcMapGestureArea::try_start_flick()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if ((m_accepted_gestures & FlickGesture) == 0)
     return false;
 
-  // If we drag then pause before release we should not cause a flick.
-  qreal velocity_x = 0.0;
-  qreal velocity_y = 0.0;
-  if (m_last_position_for_velocity_time.elapsed() < QML_MAP_FLICK_VELOCITY_SAMPLE_PERIOD) {
-    velocity_x = m_velocity_x;
-    velocity_y = m_velocity_y;
-  }
+  // If we drag then pause before release we should not cause a flick,
+  // the tracker returns a null velocity in this case.
+  const QcVectorDouble velocity = m_velocity_tracker.velocity(m_input_timestamp);
+  qreal velocity_x = qBound<qreal>(-m_flick.m_max_velocity, velocity.x(), m_flick.m_max_velocity);
+  qreal velocity_y = qBound<qreal>(-m_flick.m_max_velocity, velocity.y(), m_flick.m_max_velocity);
+
+  // A component below the threshold doesn't flick
+  if (qAbs(velocity_x) <= MINIMUM_FLICK_VELOCITY or qAbs(m_current_position.x() - m_start_position1.x()) <= FLICK_THRESHOLD)
+    velocity_x = 0;
+  if (qAbs(velocity_y) <= MINIMUM_FLICK_VELOCITY or qAbs(m_current_position.y() - m_start_position1.y()) <= FLICK_THRESHOLD)
+    velocity_y = 0;
+
+  if ((velocity_x or velocity_y) and start_flick(QcVectorDouble(velocity_x, velocity_y))) {
+    m_statistics.m_flicks_started++;
+    if (m_trace_buffer)
+      m_trace_buffer->trace_flick_start(velocity_x, velocity_y, m_flick.m_scroller->remaining_time());
+    return true;
+  } else
+    return false;
+}
 
-  int flick_time_x = 0;
-  int flick_pixels_x = 0;
-  if (qAbs(velocity_x) > MINIMUM_FLICK_VELOCITY and qAbs(m_current_position.x() - m_start_position1.x()) > FLICK_THRESHOLD) {
-    // calculate X flick animation values
-    qreal acceleration = m_flick.m_deceleration;
-    if ((velocity_x > .0f) == (m_flick.m_deceleration > .0f))
-      acceleration = -acceleration;
-    flick_time_x = static_cast<int>(-1000 * velocity_x / acceleration);
-    flick_pixels_x = (flick_time_x * velocity_x) / (1000. * 2);
-  }
+bool
+QcMapGestureArea::start_flick(const QcVectorDouble & velocity)
+{
+  qQCGestureTrace() << velocity;
 
-  // Same code for y axis
-  int flick_time_y = 0;
-  int flick_pixels_y = 0;
-  if (qAbs(velocity_y) > MINIMUM_FLICK_VELOCITY and qAbs(m_current_position.y() - m_start_position1.y()) > FLICK_THRESHOLD) {
-    // calculate Y flick animation values
-    qreal acceleration = m_flick.m_deceleration;
-    if ((velocity_y > .0f) == (m_flick.m_deceleration > .0f))
-      acceleration = -acceleration;
-    flick_time_y = static_cast<int>(-1000 * velocity_y / acceleration);
-    flick_pixels_y = (flick_time_y * velocity_y) / (1000. * 2);
-  }
+  if (!m_flick.m_scroller)
+    return false;
 
-  int flick_time = qMax(flick_time_y, flick_time_x);
-  if (flick_time > 0) {
-    start_flick(flick_pixels_x, flick_pixels_y, flick_time);
-    return true;
-  } else
+  // Map the screen velocity to the Mercator space using the local Jacobian of the projection
+  // at the viewport center, thus the bearing and the tilt are accounted
+  QcVectorDouble center_point = QcVectorDouble(m_map->width(), m_map->height()) * .5;
+  QcWgsCoordinate center_coordinate = m_map->to_coordinate(center_point, false);
+  QcWgsCoordinate dx_coordinate = m_map->to_coordinate(center_point + QcVectorDouble(1, 0), false);
+  QcWgsCoordinate dy_coordinate = m_map->to_coordinate(center_point + QcVectorDouble(0, 1), false);
+  if (isnan(center_coordinate.longitude()) or isnan(dx_coordinate.longitude()) or isnan(dy_coordinate.longitude())) {
+    qWarning() << "Screen coordinate are nan";
     return false;
+  }
+
+  QcVectorDouble center = QcKineticScroller::wgs84_to_mercator(center_coordinate.longitude(), center_coordinate.latitude());
+  QcVectorDouble jx = QcKineticScroller::wgs84_to_mercator(dx_coordinate.longitude(), dx_coordinate.latitude()) - center;
+  QcVectorDouble jy = QcKineticScroller::wgs84_to_mercator(dy_coordinate.longitude(), dy_coordinate.latitude()) - center;
+  // the offset can cross the antimeridian
+  jx = QcVectorDouble(jx.x() - std::round(jx.x()), jx.y());
+  jy = QcVectorDouble(jy.x() - std::round(jy.x()), jy.y());
+
+  // the camera moves in the opposite direction of the finger
+  QcVectorDouble mercator_velocity = (jx * velocity.x() + jy * velocity.y()) * -1.;
+  double deceleration = m_flick.m_deceleration * mercator_velocity.magnitude() / velocity.magnitude();
+
+  m_flick.m_scroller->fling(coordinate_to_mercator(m_map->center()), mercator_velocity, deceleration);
+  m_flick.m_position = m_flick.m_scroller->position();
+  return true;
 }
 
+// Slot
 void
-QcMapGestureArea::start_flick(int dx, int dy, int time_ms)
+QcMapGestureArea::handle_scroller_updated(QcKineticScroller::Channels channels)
 {
-  qQCInfo();
-
-  if (!m_flick.m_animation)
-    return;
-  if (time_ms < 0)
-    return;
+  if (channels & QcKineticScroller::ZoomLevel)
+    m_map->set_zoom_level(m_flick.m_scroller->zoom_level());
+  if (channels & QcKineticScroller::Position) {
+    // The flick is applied as a displacement, since the zoom anchoring moves the center too,
+    // the displacement can cross the antimeridian
+    QcVectorDouble delta = m_flick.m_scroller->position() - m_flick.m_position;
+    delta = QcVectorDouble(delta.x() - std::round(delta.x()), delta.y());
+    m_flick.m_position = m_flick.m_scroller->position();
+    if (channels & QcKineticScroller::ZoomLevel)
+      // the map slides under the anchor point
+      m_pinch.m_zoom.m_anchor = m_pinch.m_zoom.m_anchor + delta;
+    else
+      m_map->set_center(mercator_to_coordinate(coordinate_to_mercator(m_map->center()) + delta));
+  }
+  // the zoom is centered on the last touch centroid
+  if (channels & QcKineticScroller::ZoomLevel)
+    align_coordinate_to_point(mercator_to_coordinate(m_pinch.m_zoom.m_anchor), m_pinch.m_zoom.m_anchor_point);
+  m_statistics.m_camera_updates++;
+}
 
-  QcWgsCoordinate animation_start_coordinate = m_map->center();
-
-  // Fixme: could be placed before ?
-  if (m_flick.m_animation->isRunning())
-    m_flick.m_animation->stop();
-
-  // Fixme: better calculation to roll the globe ?
-  double zoom = pow(2.0, m_map->zoom_level());
-  double longitude = animation_start_coordinate.longitude() - (dx / zoom);
-  double latitude = animation_start_coordinate.latitude() + (dy / zoom);
-
-  // Fixme: must be done according to projection (and viewport ?)
-  // keep animation in correct bounds
-  qQCInfo() << longitude << latitude;
-  if (latitude > 85.05113)
-    latitude = 85.05113;
-  else if (latitude < -85.05113)
-    latitude = -85.05113;
-  if (longitude > 180)
-    longitude = longitude - 360;
-  else if (longitude < -180)
-    longitude = longitude + 360;
-
-  QcWgsCoordinate animation_end_coordinate(longitude, latitude);
-  // qQCInfo() << animation_start_coordinate << animation_end_coordinate << dx;
-
-  m_flick.m_animation->setFrom(animation_start_coordinate);
-  m_flick.m_animation->setTo(animation_end_coordinate);
-  m_flick.m_animation->setDirection(dx > 0 ? QcGeoCoordinateAnimation::East : QcGeoCoordinateAnimation::West);
-  m_flick.m_animation->setDuration(time_ms);
-  m_flick.m_animation->start();
+// Slot
+void
+QcMapGestureArea::handle_scroller_finished(QcKineticScroller::Channels channels)
+{
+  if (channels & QcKineticScroller::Position)
+    handle_flick_animation_stopped();
 }
 
 // Called from set_pan_enabled
 void
 QcMapGestureArea::stop_pan()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   if (m_flick_state == FlickActive)
     stop_flick();
   else if (m_flick_state == PanActive) {
-    m_velocity_x = 0;
-    m_velocity_y = 0;
-    m_flick_state = FlickInactive;
+    m_velocity_tracker.clear();
+    m_resample_timer.stop();
+    set_flick_state(FlickInactive);
     m_map->setKeepMouseGrab(m_prevent_stealing);
     emit pan_finished();
     emit pan_activeChanged();
@@ -1317,28 +1617,29 @@ QcMapGestureArea::stop_pan()
 void
 QcMapGestureArea::stop_flick()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
-  if (!m_flick.m_animation)
+  if (!m_flick.m_scroller)
     return;
 
-  m_velocity_x = 0;
-  m_velocity_y = 0;
-  if (m_flick.m_animation->isRunning())
-    m_flick.m_animation->stop();
-  else
-    handle_flick_animation_stopped();
+  m_velocity_tracker.clear();
+  if (m_flick.m_scroller->is_active(QcKineticScroller::Position))
+    m_statistics.m_flicks_aborted++;
+  m_flick.m_scroller->stop_channels(QcKineticScroller::Position);
+  handle_flick_animation_stopped();
 }
 
 // Slot
 void
 QcMapGestureArea::handle_flick_animation_stopped()
 {
-  qQCInfo();
+  qQCGestureTrace();
 
   m_map->setKeepMouseGrab(m_prevent_stealing);
   if (m_flick_state == FlickActive) {
-    m_flick_state = FlickInactive;
+    if (m_trace_buffer)
+      m_trace_buffer->trace_flick_stop();
+    set_flick_state(FlickInactive);
     emit flick_finished();
     m_map->prefetch_data();
   }
@@ -69,14 +69,21 @@
 
 /**************************************************************************************************/
 
-#include "geo_coordinate_animation.h"
+#include "map_gesture_kinetic_scroller.h"
+#include "map_gesture_resampler.h"
+#include "map_gesture_statistics.h"
+#include "map_gesture_touch_point.h"
+#include "map_gesture_velocity_tracker.h"
 #include "coordinate/mercator.h"
 #include "coordinate/wgs84.h"
 #include "geometry/vector.h"
 #include "math/interval.h"
 
+#include <optional>
+
 #include <QDebug> // Fixme: QtDebug ???
 #include <QElapsedTimer>
+#include <QTimer>
 #include <QTouchEvent>
 #include <QtQuick/QQuickItem>
 
@@ -85,6 +92,8 @@
 // QT_BEGIN_NAMESPACE
 
 class QcMapItem;
+class QcGestureRecorder;
+class QcGestureTraceBuffer;
 
 /**************************************************************************************************/
 
@@ -160,6 +169,9 @@ struct Zoom
   qreal m_start;
   qreal m_previous;
   qreal maximum_change;
+  QcVelocityTracker m_velocity_tracker; // zoom rate, on x
+  QcVectorDouble m_anchor_point; // the zoom inertia is anchored at the last touch centroid
+  QcVectorDouble m_anchor; // coordinate under the anchor point, in normalised Mercator coordinates
 };
 
 /**************************************************************************************************/
@@ -183,12 +195,32 @@ struct Pinch
 
 /**************************************************************************************************/
 
+// Mouse press data required to report a press and hold
+struct QcMousePress
+{
+  QcMousePress()
+    : m_button(Qt::NoButton),
+      m_buttons(Qt::NoButton),
+      m_modifiers(Qt::NoModifier)
+  {}
+
+  QPointF m_position;
+  QPointF m_scene_position;
+  QPointF m_global_position;
+  Qt::MouseButton m_button;
+  Qt::MouseButtons m_buttons;
+  Qt::KeyboardModifiers m_modifiers;
+};
+
+/**************************************************************************************************/
+
 struct Pan
 {
   bool m_enabled;
   qreal m_max_velocity;
   qreal m_deceleration;
-  QcGeoCoordinateAnimation * m_animation; // Fixme
+  QcKineticScroller * m_scroller; // map center and zoom level inertia
+  QcVectorDouble m_position; // flick position applied to the camera, in normalised Mercator coordinates
 };
 
 /**************************************************************************************************/
@@ -198,6 +230,7 @@ class QcMapGestureArea: public QQuickItem
   Q_OBJECT
 
   Q_ENUMS(GeoMapGesture)
+  Q_ENUMS(UpdateMode)
   Q_FLAGS(AcceptedGestures)
 
   Q_PROPERTY(bool enabled READ enabled WRITE set_enabled NOTIFY enabledChanged)
@@ -207,6 +240,9 @@ class QcMapGestureArea: public QQuickItem
   Q_PROPERTY(qreal maximum_zoom_level_change READ maximum_zoom_level_change WRITE set_maximum_zoom_level_change NOTIFY maximum_zoom_level_changeChanged)
   Q_PROPERTY(qreal flick_deceleration READ flick_deceleration WRITE set_flick_deceleration NOTIFY flick_decelerationChanged)
   Q_PROPERTY(bool prevent_stealing READ prevent_stealing WRITE set_prevent_stealing NOTIFY prevent_stealingChanged)
+  Q_PROPERTY(UpdateMode update_mode READ update_mode WRITE set_update_mode NOTIFY update_modeChanged)
+  Q_PROPERTY(int prediction_horizon READ prediction_horizon WRITE set_prediction_horizon NOTIFY prediction_horizonChanged)
+  Q_PROPERTY(QcGestureStatisticsObject * statistics READ statistics_object CONSTANT)
 
 public:
   QcMapGestureArea(QcMapItem * map);
@@ -221,6 +257,11 @@ public:
 
   Q_DECLARE_FLAGS(AcceptedGestures, GeoMapGesture)
 
+  enum UpdateMode {
+    ImmediateUpdate, // run the state machines on each input event
+    FrameUpdate      // coalesce move events and run the state machines once per frame
+  };
+
   AcceptedGestures accepted_gestures() const { return m_accepted_gestures; }
   void set_accepted_gestures(AcceptedGestures accepted_gestures);
 
@@ -242,6 +283,24 @@ public:
   bool prevent_stealing() const { return m_prevent_stealing; }
   void set_prevent_stealing(bool prevent);
 
+  UpdateMode update_mode() const { return m_update_mode; }
+  void set_update_mode(UpdateMode mode);
+
+  int prediction_horizon() const { return m_resampler.horizon(); }
+  void set_prediction_horizon(int horizon);
+
+  void flush_pending_update();
+
+  QcGestureRecorder * recorder() const { return m_recorder; }
+  void set_recorder(QcGestureRecorder * recorder) { m_recorder = recorder; }
+
+  QcGestureTraceBuffer * trace_buffer() const { return m_trace_buffer; }
+  void set_trace_buffer(QcGestureTraceBuffer * trace_buffer) { m_trace_buffer = trace_buffer; }
+
+  const QcGestureStatistics & statistics() const { return m_statistics; }
+  QcGestureStatisticsObject * statistics_object() const { return m_statistics_object; }
+  Q_INVOKABLE void reset_statistics() { m_statistics.reset(); }
+
   void handle_touch_event(QTouchEvent * event);
   void handle_wheel_event(QWheelEvent * event);
   void handle_mouse_press_event(QMouseEvent * event);
@@ -250,6 +309,9 @@ public:
   void handle_mouse_ungrab_event();
   void handle_touch_ungrab_event();
 
+protected:
+  void updatePolish() override;
+
 Q_SIGNALS:
   void pan_activeChanged();
   void pinch_activeChanged();
@@ -265,11 +327,14 @@ Q_SIGNALS:
   void flick_started();
   void flick_finished();
   void prevent_stealingChanged();
+  void update_modeChanged();
+  void prediction_horizonChanged();
 
 private:
-  const QTouchEvent::TouchPoint & first_point() const  { return m_all_points.at(0); }
-  const QTouchEvent::TouchPoint & second_point() const { return m_all_points.at(1); }
+  const QcTouchPoint & first_point() const  { return m_all_points.at(0); }
+  const QcTouchPoint & second_point() const { return m_all_points.at(1); }
 
+  void request_update(bool coalescable);
   void update();
 
   bool is_press_and_hold();
@@ -288,14 +353,17 @@ private:
   void start_pinch();
   void update_pinch();
   void end_pinch();
+  void start_zoom_inertia();
 
   // Pan related code (regardles of number of touch points),
   // includes the flick based panning after letting go
   void pan_state_machine();
   bool can_start_pan();
   void update_pan();
+  void align_coordinate_to_point(const QcWgsCoordinate & coordinate, const QcVectorDouble & point);
+  bool camera_changed(const QcWgsCoordinate & center, double zoom_level) const;
   bool try_start_flick();
-  void start_flick(int dx, int dy, int time_ms = 0);
+  bool start_flick(const QcVectorDouble & velocity); // [px/s]
   void stop_flick();
 
   bool pinch_enabled() const { return m_pinch.m_enabled; }
@@ -307,12 +375,16 @@ private:
 
 private slots:
   void handle_flick_animation_stopped();
+  void handle_scroller_updated(QcKineticScroller::Channels channels);
+  void handle_scroller_finished(QcKineticScroller::Channels channels);
   void handle_press_timer_timeout();
+  void handle_resample_timer_timeout();
 
 private:
   void stop_pan();
+  void set_mouse_point(const QMouseEvent * event, QEventPoint::State state);
   void clear_touch_data();
-  void update_velocity_list(const QcVectorDouble & pos);
+  void add_input_sample(quint64 timestamp);
 
 private:
   // prototype state machine...
@@ -337,24 +409,29 @@ private:
       FlickActive
     } m_flick_state;
 
+  void set_touch_point_state(TouchPointState state);
+  void set_pinch_state(PinchState state);
+  void set_flick_state(FlickState state);
+
 private:
   QcMapItem * m_map;
   bool m_enabled;
   AcceptedGestures m_accepted_gestures;
 
   // These are calculated regardless of gesture or number of touch points
-  QScopedPointer<QTouchEvent::TouchPoint> m_mouse_point; // mouse event data (pointer so as to by undefined)
-  QList<QTouchEvent::TouchPoint> m_touch_points; // touch event data
-  QList<QTouchEvent::TouchPoint> m_all_points; // combined (touch and mouse) event data
+  std::optional<QcTouchPoint> m_mouse_point; // mouse event data, overwritten in place
+  QcTouchPoints m_touch_points; // touch event data
+  QcTouchPoints m_all_points; // combined (touch and mouse) event data
+  QcTouchPointsGeometry m_touch_geometry; // centroid, spread and angle of all the points
 
-  QcVectorDouble m_last_position_for_velocity; // used to compute velocity; first point or middle item position, then updated
-  QElapsedTimer m_last_position_for_velocity_time; // used to compute velocity
-  qreal m_velocity_x; // [px/s]
-  qreal m_velocity_y;
+  QcVelocityTracker m_velocity_tracker; // first point or middle item positions, used to compute velocity
+  quint64 m_input_timestamp; // timestamp of the latest input event [ms]
+  QcGestureStatistics m_statistics;
+  QcGestureStatisticsObject * m_statistics_object;
 
   QTimer m_press_timer; // used to detect press and hold
   bool m_was_press_and_hold;
-  QScopedPointer<QMouseEvent> m_mouse_event;
+  QcMousePress m_mouse_press;
   QElapsedTimer m_press_time; // used to detect press and hold
   QElapsedTimer m_double_press_time; // used to detect double click
   QcVectorDouble m_start_position1; // first point item position
@@ -369,6 +446,15 @@ private:
   bool m_prevent_stealing;
   bool m_pan_enabled;
 
+  UpdateMode m_update_mode;
+  bool m_update_pending; // coalesced input waiting for the polish
+
+  QcTouchResampler m_resampler; // touch centroid used to pan
+  QTimer m_resample_timer; // the pan is realigned to the raw centroid when the finger pauses
+
+  QcGestureRecorder * m_recorder; // not owned, record the raw input if set
+  QcGestureTraceBuffer * m_trace_buffer; // not owned, trace the state machines if set
+
   struct Pinch m_pinch;
   struct Pan m_flick;
 };
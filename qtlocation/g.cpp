@@ -67,6 +67,8 @@
 #include "qtcarto.h"
 
 #include "declarative_map_item.h"
+#include "map_gesture_recorder.h"
+#include "map_gesture_trace.h"
 
 #include <cmath>
 
@@ -427,7 +429,7 @@ QT_BEGIN_NAMESPACE
 constexpr int QML_MAP_FLICK_MINIMUM_DECELERATION = 500;
 // constexpr int QML_MAP_FLICK_DEFAULT_DECELERATION = 2500;
 constexpr int QML_MAP_FLICK_MAXIMUM_DECELERATION = 10000;
-constexpr int QML_MAP_FLICK_VELOCITY_SAMPLE_PERIOD = 38;
+// constexpr int QML_MAP_FLICK_VELOCITY_SAMPLE_PERIOD = 38; // see QcVelocityTracker
 
 // FlickThreshold determines how far the "mouse" must have moved
 // before we perform a flick.
@@ -444,6 +446,16 @@ static const qreal MinimumRotationStartingAngle = 15.0; // in degrees
 static const qreal MinimumPinchDelta = 40; // in pixels
 // Tolerance for starting tilt when sliding vertical
 static const qreal MinimumPanToTiltDelta = 80; // in pixels;
+// Tolerance for starting a three finger drag, no need to disambiguate it from a pan
+static const qreal MinimumThreeFingerDragDelta = 20; // in pixels
+// Approach: 10pixel = 1 degree.
+static const qreal TiltRate = 0.1; // in degrees/pixel
+static const qreal ThreeFingerBearingRate = 0.25; // in degrees/pixel
+// Zoom and rotation inertia after lifting the fingers
+static const qreal MinimumZoomInertiaRate = 0.5; // in zoom level/s
+static const qreal MaximumZoomInertiaRate = 8; // in zoom level/s
+static const qreal MinimumBearingInertiaRate = 20; // in degrees/s
+static const qreal MaximumBearingInertiaRate = 720; // in degrees/s
 
 /**************************************************************************************************/
 
@@ -463,16 +475,6 @@ angle_from_points(const QcVectorDouble & p1, const QcVectorDouble & p2)
   return (p2 - p1).orientation();
 }
 
-// Keeps it in +- 180
-static qreal
-touch_angle(const QcVectorDouble & p1, const QcVectorDouble & p2)
-{
-  auto angle = angle_from_points(p1, p2);
-  if (angle > 180)
-    angle -= 360;
-  return angle;
-}
-
 // Deals with angles crossing the +-180 edge, assumes that the delta can't be > 180
 static qreal
 angle_delta(const qreal angle1, const qreal angle2)
@@ -486,6 +488,20 @@ angle_delta(const qreal angle1, const qreal angle2)
   return delta;
 }
 
+static QcVectorDouble
+coordinate_to_mercator(const QGeoCoordinate & coordinate)
+{
+  return QcKineticScroller::wgs84_to_mercator(coordinate.longitude(), coordinate.latitude());
+}
+
+static QGeoCoordinate
+mercator_to_coordinate(const QcVectorDouble & mercator)
+{
+  // wrap around the antimeridian
+  QcVectorDouble coordinate = QcKineticScroller::mercator_to_wgs84(QcVectorDouble(mercator.x() - std::floor(mercator.x()), mercator.y()));
+  return QGeoCoordinate(coordinate.y(), coordinate.x());
+}
+
 static bool
 point_dragged(const QcVectorDouble & p_old, const QcVectorDouble & p_new)
 {
@@ -541,13 +557,23 @@ QcMapGestureArea::QcMapGestureArea(QcMapItem * map)
   , m_declarative_map(map)
   , m_enabled(true)
   , m_accepted_gestures(PinchGesture | PanGesture | FlickGesture | RotationGesture | TiltGesture)
+  , m_input_timestamp(0)
+  , m_prefetch_id(0)
+  , m_statistics()
+  , m_statistics_object(new QcGestureStatisticsObject(&m_statistics, this))
   , m_prevent_stealing(false)
+  , m_update_mode(ImmediateUpdate)
+  , m_update_pending(false)
+  , m_three_finger_drag(NoThreeFingerDrag)
+  , m_direct_manipulation(false)
+  , m_recorder(nullptr)
+  , m_trace_buffer(nullptr)
 {
   m_touch_point_state = TouchPoints0;
-  m_pinch_state = PinchInactive;
   m_flick_state = FlickInactive;
-  m_rotation_state = RotationInactive;
-  m_tilt_state = TiltInactive;
+
+  m_resample_timer.setSingleShot(true);
+  connect(&m_resample_timer, &QTimer::timeout, this, &QcMapGestureArea::handle_resample_timer_timeout);
 }
 
 /// \internal
@@ -558,11 +584,9 @@ QcMapGestureArea::set_map(QcMapItem * map)
     return;
 
   m_map = map;
-  m_flick.m_animation = new QcGeoCoordinateAnimation(this);
-  m_flick.m_animation->setTargetObject(m_declarative_map);
-  m_flick.m_animation->setProperty(QStringLiteral("center"));
-  m_flick.m_animation->setEasing(QEasingCurve(QEasingCurve::OutQuad));
-  connect(m_flick.m_animation, &QQuickAbstractAnimation::stopped, this, &QcMapGestureArea::handle_flick_animation_stopped);
+  m_flick.m_scroller = new QcKineticScroller(this);
+  connect(m_flick.m_scroller, &QcKineticScroller::updated, this, &QcMapGestureArea::handle_scroller_updated);
+  connect(m_flick.m_scroller, &QcKineticScroller::channels_finished, this, &QcMapGestureArea::handle_scroller_finished);
   m_map->set_accepted_gestures(pan_enabled(), flick_enabled(), pinch_enabled(), rotation_enabled(), tilt_enabled());
 }
 
@@ -602,6 +626,164 @@ QcMapGestureArea::set_prevent_stealing(bool prevent)
 
 QcMapGestureArea::~QcMapGestureArea() {}
 
+/*!
+  \qmlproperty enumeration QtLocation::MapGestureArea::update_mode
+
+  This property holds when the gesture state machines process the input.
+
+  \value MapGestureArea.ImmediateUpdate
+  Each input event runs the state machines and updates the camera (default).
+
+  \value MapGestureArea.FrameUpdate
+  Move events are accumulated and processed once per frame, just before the
+  scene graph is synchronized, so that each frame produces at most one camera
+  update. Press and release events are still processed immediately.
+*/
+
+QcMapGestureArea::UpdateMode
+QcMapGestureArea::update_mode() const
+{
+  return m_update_mode;
+}
+
+void
+QcMapGestureArea::set_update_mode(UpdateMode mode)
+{
+  if (mode == m_update_mode)
+    return;
+  m_update_mode = mode;
+  // don't leave input behind when switching to the immediate mode
+  flush_pending_update();
+  emit update_modeChanged();
+}
+
+/*!
+  \qmlproperty int QtLocation::MapGestureArea::prediction_horizon
+
+  This property holds how far in the future, in milliseconds, the touch position
+  is predicted when panning.
+
+  The pan follows the touch position extrapolated to the time of the frame plus
+  this horizon, which compensates the delay between the input and the display.
+  The prediction is disabled when the input is too irregular.  A value of 0
+  disables the resampling (default).
+*/
+
+int
+QcMapGestureArea::prediction_horizon() const
+{
+  return m_resampler.horizon();
+}
+
+void
+QcMapGestureArea::set_prediction_horizon(int horizon)
+{
+  if (horizon == m_resampler.horizon())
+    return;
+  m_resampler.set_horizon(horizon);
+  emit prediction_horizonChanged();
+}
+
+/*!
+  \qmlproperty enumeration QtLocation::MapGestureArea::velocity_estimator
+
+  This property holds how the flick velocity is estimated from the last
+  positions of the touch points, using the timestamps of the input events.
+
+  \value MapGestureArea.TwoPointVelocity
+  Displacement between the oldest and the latest position of the last 100 ms.
+
+  \value MapGestureArea.LeastSquaresVelocity
+  Weighted least squares fit of the last 100 ms (default).
+
+  \value MapGestureArea.ImpulseVelocity
+  Velocity derived from the work done by the finger over the last 100 ms.
+*/
+
+QcMapGestureArea::VelocityEstimator
+QcMapGestureArea::velocity_estimator() const
+{
+  return static_cast<VelocityEstimator>(m_velocity_tracker.estimator());
+}
+
+void
+QcMapGestureArea::set_velocity_estimator(VelocityEstimator estimator)
+{
+  if (estimator == velocity_estimator())
+    return;
+  m_velocity_tracker.set_estimator(static_cast<QcVelocityTracker::Estimator>(estimator));
+  emit velocity_estimatorChanged();
+}
+
+/*!
+  \qmlproperty enumeration QtLocation::MapGestureArea::three_finger_drag
+
+  This property holds the camera controls mapped to a drag with three fingers
+  or more.
+
+  A three finger drag is recognised from the touch centroid as soon as it
+  translates, thus it locks faster than the two finger tilt, which has to be
+  disambiguated from a pinch or a rotation.  When it is enabled, the two finger
+  tilt is disabled, and three fingers don't start a pinch or a rotation.  The
+  tilt signals are emitted for the drag.
+
+  \value MapGestureArea.NoThreeFingerDrag
+  Three fingers behave like two, tilt with a two finger vertical drag (default).
+
+  \value MapGestureArea.TiltDrag
+  A vertical drag tilts the map.
+
+  \value MapGestureArea.TiltAndBearingDrag
+  A vertical drag tilts the map and an horizontal drag rotates it.
+*/
+
+QcMapGestureArea::ThreeFingerDrag
+QcMapGestureArea::three_finger_drag() const
+{
+  return m_three_finger_drag;
+}
+
+void
+QcMapGestureArea::set_three_finger_drag(ThreeFingerDrag mapping)
+{
+  if (mapping == m_three_finger_drag)
+    return;
+  m_three_finger_drag = mapping;
+  emit three_finger_dragChanged();
+}
+
+/*!
+  \qmlproperty bool QtLocation::MapGestureArea::direct_manipulation
+
+  This property holds whether the pinch and the rotation are solved at once as
+  a similarity transform of the touch points.
+
+  The scale is the ratio of the spread of the touch points to the one at the
+  start of the gesture, the rotation is the rotation of the touch points, and
+  the translation keeps the coordinate under the touch centroid at the start of
+  the gesture under the centroid.  The zoom level, the bearing and the center
+  are applied as one camera update, thus the map sticks to the fingers.  The
+  gesture is reported by the pinch signals, the angle of the event is set.
+
+  When false, the zoom level follows linearly the distance between the touch
+  points, and the pinch and the rotation start independently (default).
+*/
+
+bool
+QcMapGestureArea::direct_manipulation() const
+{
+  return m_direct_manipulation;
+}
+
+void
+QcMapGestureArea::set_direct_manipulation(bool enabled)
+{
+  if (enabled == m_direct_manipulation)
+    return;
+  m_direct_manipulation = enabled;
+  emit direct_manipulationChanged();
+}
+
 /*!
   \qmlproperty enumeration QtLocation::MapGestureArea::accepted_gestures
 
@@ -658,21 +840,21 @@ QcMapGestureArea::set_accepted_gestures(AcceptedGestures accepted_gestures)
 bool
 QcMapGestureArea::is_pinch_active() const
 {
-  return m_pinch_state == PinchActive;
+  return m_arbiter.is_active(PinchRecognizer | TransformRecognizer);
 }
 
 /// \internal
 bool
 QcMapGestureArea::is_rotation_active() const
 {
-  return m_rotation_state == RotationActive;
+  return m_arbiter.is_active(RotationRecognizer);
 }
 
 /// \internal
 bool
 QcMapGestureArea::is_tilt_active() const
 {
-  return m_tilt_state == TiltActive;
+  return m_arbiter.is_active(TiltRecognizer);
 }
 
 /// \internal
@@ -883,32 +1065,32 @@ QcMapGestureArea::set_flick_deceleration(qreal deceleration)
 }
 
 /// \internal
-QTouchEvent::TouchPoint *
-createTouchPointFromMouseEvent(QMouseEvent * event, Qt::TouchPointState state)
+void
+QcMapGestureArea::set_mouse_point(const QMouseEvent * event, QEventPoint::State state)
 {
-  // this is only partially filled. But since it is only partially used it works
-  // more robust would be to store a list of QcVectorDoubles rather than TouchPoints
-  QTouchEvent::TouchPoint * newPoint = new QTouchEvent::TouchPoint();
-  newPoint->setPos(event->position());
-  newPoint->setScenePos(event->windowPos());
-  newPoint->setScreenPos(event->screenPos());
-  newPoint->setState(state);
-  newPoint->setId(0);
-  return newPoint;
+  // the synthetic point is overwritten in place, a mouse move must not allocate
+  if (!m_mouse_point)
+    m_mouse_point.emplace();
+  m_mouse_point->set(event, state);
 }
 
 /// \internal
 void
 QcMapGestureArea::handle_mouse_press_event(QMouseEvent * event)
 {
+  m_statistics.count_event(QcGestureStatistics::MousePressEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+  m_input_timestamp = event->timestamp();
+
   if (m_map && m_map->handleEvent(event)) {
     event->accept();
     return;
   }
 
-  m_mouse_point.reset(createTouchPointFromMouseEvent(event, QEventPoint::State::Pressed));
+  set_mouse_point(event, QEventPoint::State::Pressed);
   if (m_touch_points.isEmpty())
-    update();
+    request_update(false);
   event->accept();
 }
 
@@ -916,14 +1098,19 @@ QcMapGestureArea::handle_mouse_press_event(QMouseEvent * event)
 void
 QcMapGestureArea::handle_mouse_move_event(QMouseEvent * event)
 {
+  m_statistics.count_event(QcGestureStatistics::MouseMoveEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+  m_input_timestamp = event->timestamp();
+
   if (m_map && m_map->handleEvent(event)) {
     event->accept();
     return;
   }
 
-  m_mouse_point.reset(createTouchPointFromMouseEvent(event, QEventPoint::State::Updated));
+  set_mouse_point(event, QEventPoint::State::Updated);
   if (m_touch_points.isEmpty())
-    update();
+    request_update(true);
   event->accept();
 }
 
@@ -931,17 +1118,22 @@ QcMapGestureArea::handle_mouse_move_event(QMouseEvent * event)
 void
 QcMapGestureArea::handle_mouse_release_event(QMouseEvent * event)
 {
+  m_statistics.count_event(QcGestureStatistics::MouseReleaseEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+  m_input_timestamp = event->timestamp();
+
   if (m_map && m_map->handleEvent(event)) {
     event->accept();
     return;
   }
 
-  if (!m_mouse_point.isNull()) {
+  if (m_mouse_point) {
     //this looks super ugly , however is required in case we do not get synthesized MouseReleaseEvent
     //and we reset the point already in handle_touch_ungrab_event
-    m_mouse_point.reset(createTouchPointFromMouseEvent(event, QEventPoint::State::Released));
+    set_mouse_point(event, QEventPoint::State::Released);
     if (m_touch_points.isEmpty())
-      update();
+      request_update(false);
   }
   event->accept();
 }
@@ -950,9 +1142,10 @@ QcMapGestureArea::handle_mouse_release_event(QMouseEvent * event)
 void
 QcMapGestureArea::handle_mouse_ungrab_event()
 {
-  if (m_touch_points.isEmpty() && !m_mouse_point.isNull()) {
+  m_statistics.count_event(QcGestureStatistics::UngrabEvent);
+  if (m_touch_points.isEmpty() && m_mouse_point) {
     m_mouse_point.reset();
-    update();
+    request_update(false);
   } else {
     m_mouse_point.reset();
   }
@@ -962,17 +1155,23 @@ QcMapGestureArea::handle_mouse_ungrab_event()
 void
 QcMapGestureArea::handle_touch_ungrab_event()
 {
+  m_statistics.count_event(QcGestureStatistics::UngrabEvent);
   m_touch_points.clear();
   //this is needed since in some cases mouse release is not delivered
   //(second touch point breaks mouse synthesized events)
   m_mouse_point.reset();
-  update();
+  request_update(false);
 }
 
 /// \internal
 void
 QcMapGestureArea::handle_touch_event(QTouchEvent * event)
 {
+  m_statistics.count_event(QcGestureStatistics::TouchEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+  m_input_timestamp = event->timestamp();
+
   if (m_map && m_map->handleEvent(event)) {
     event->accept();
     return;
@@ -981,16 +1180,21 @@ QcMapGestureArea::handle_touch_event(QTouchEvent * event)
   m_touch_points.clear();
   m_mouse_point.reset();
 
-  for (int i = 0; i < event->touch_points().count(); ++i) {
-    auto point = event->touch_points().at(i);
-    if (point.state() != QEventPoint::State::Released)
-      m_touch_points << point;
+  // fill the inline buffer in place, QEventPoint copies are not free
+  const QList<QEventPoint> & points = event->points();
+  for (const QEventPoint & point : points) {
+    if (point.state() != QEventPoint::State::Released && !m_touch_points.append(point))
+      break;
   }
-  if (event->touch_points().count() >= 2)
+  if (points.count() >= 2)
     event->accept();
   else
     event->ignore();
-  update();
+
+  // only pure moves can be coalesced, a press or a release changes the number of points
+  const bool coalescable = event->type() == QEvent::TouchUpdate
+    && !(event->touchPointStates() & (QEventPoint::State::Pressed | QEventPoint::State::Released));
+  request_update(coalescable);
 }
 
 #if QT_CONFIG(wheelevent)
@@ -1000,6 +1204,10 @@ QcMapGestureArea::handle_wheel_event(QWheelEvent * event)
   if (!m_map)
     return;
 
+  m_statistics.count_event(QcGestureStatistics::WheelEvent);
+  if (m_recorder)
+    m_recorder->record(event);
+
   if (m_map->handleEvent(event)) {
     event->accept();
     return;
@@ -1009,6 +1217,7 @@ QcMapGestureArea::handle_wheel_event(QWheelEvent * event)
   const QcVectorDouble & preZoomPoint = event->position();
 
   // Not using AltModifier as, for some reason, it causes angle_delta to be 0
+  m_declarative_map->beginCameraUpdate();
   if (event->modifiers() & Qt::ShiftModifier && rotation_enabled()) {
     emit rotation_started(&m_pinch.m_event);
     // First set bearing
@@ -1031,6 +1240,12 @@ QcMapGestureArea::handle_wheel_event(QWheelEvent * event)
     if (preZoomPoint != postZoomPoint) // need to re-anchor the wheel geoPos to the event position
       m_declarative_map->alignCoordinateToPoint(wheelGeoPos, preZoomPoint);
   }
+  // a wheel step at a zoom level limit doesn't change the camera
+  if (m_declarative_map->commitCameraUpdate()) {
+    m_statistics.m_camera_updates++;
+    m_statistics.add_input_latency(event->timestamp());
+    m_declarative_map->tagCameraUpdate(event->timestamp());
+  }
   event->accept();
 }
 #endif
@@ -1042,6 +1257,7 @@ QcMapGestureArea::clear_touch_data()
   m_flick_vector = QVector2D();
   m_touch_pointsCentroid.setX(0);
   m_touch_pointsCentroid.setY(0);
+  m_touch_geometry.clear();
   m_touch_center_coordinate.setLongitude(0);
   m_touch_center_coordinate.setLatitude(0);
   m_start_coordinate.setLongitude(0);
@@ -1049,59 +1265,96 @@ QcMapGestureArea::clear_touch_data()
 }
 
 /// \internal
+/// Record the centroid of the latest input with the timestamp of its event, it is used later
+/// to determine the flick velocity (when the fingers are lifted) and to resample the pan.
+/// This is called for each move before the update is coalesced, thus the tracker and the
+/// resampler see all the samples of a frame and not only the last one.
 void
-QcMapGestureArea::update_flick_parameters(const QcVectorDouble & pos)
-{
-  // Take velocity samples every sufficient period of time, used later to determine the flick
-  // duration and speed (when mouse is released).
-  qreal elapsed = qreal(m_last_position_time.elapsed());
-
-  if (elapsed >= QML_MAP_FLICK_VELOCITY_SAMPLE_PERIOD) {
-    elapsed /= 1000.;
-    qreal vel = distance_between_touch_points(pos, m_last_position) / elapsed;
-    m_flick_vector = (QVector2D(pos) - QVector2D(m_last_position)).normalized();
-    m_flick_vector *= qBound<qreal>(-m_flick.m_max_velocity, vel, m_flick.m_max_velocity);
-
-    m_last_position = pos;
-    m_last_position_time.restart();
+QcMapGestureArea::add_input_sample(quint64 timestamp)
+{
+  QcVectorDouble centroid;
+  int count = 0;
+  if (!m_touch_points.isEmpty()) {
+    for (const QcTouchPoint & point : m_touch_points)
+      centroid = centroid + QcVectorDouble(mapFromScene(point.scene_position()));
+    count = m_touch_points.count();
+  } else if (m_mouse_point) {
+    centroid = mapFromScene(m_mouse_point->scene_position());
+    count = 1;
   }
+  if (!count)
+    return;
+  centroid = centroid * (1. / count);
+
+  m_velocity_tracker.add_sample(timestamp, centroid);
+  m_resampler.add_sample(timestamp, centroid);
 }
 
 void
 QcMapGestureArea::set_touch_point_state(const QcMapGestureArea::TouchPointState state)
 {
+  if (m_trace_buffer && state != m_touch_point_state)
+    m_trace_buffer->trace_transition(QcGestureTraceRecord::TouchPointMachine, m_touch_point_state, state);
   m_touch_point_state = state;
 }
 
 void
 QcMapGestureArea::set_flick_state(const QcMapGestureArea::FlickState state)
 {
+  if (m_trace_buffer && state != m_flick_state)
+    m_trace_buffer->trace_transition(QcGestureTraceRecord::FlickMachine, m_flick_state, state);
   m_flick_state = state;
 }
 
-void
-QcMapGestureArea::set_tilt_state(const QcMapGestureArea::TiltState state)
+/// \internal
+bool
+QcMapGestureArea::is_active() const
 {
-  m_tilt_state = state;
+  return is_pan_active() || is_pinch_active() || is_rotation_active() || is_tilt_active();
 }
 
+/// \internal
+/// Process the input now, or defer it to the next frame in FrameUpdate mode.
+/// The point buffers always hold the latest input, thus a deferred update
+/// simply catches up with all the events received since the last frame.
 void
-QcMapGestureArea::set_rotation_state(const QcMapGestureArea::RotationState state)
+QcMapGestureArea::request_update(bool coalescable)
 {
-  m_rotation_state = state;
+  // a press or a release restarts or ends the tracking, the state machines take the first sample
+  if (coalescable)
+    add_input_sample(m_input_timestamp);
+
+  if (coalescable && m_update_mode == FrameUpdate && window()) {
+    if (!m_update_pending) {
+      m_update_pending = true;
+      polish();
+    }
+    return;
+  }
+
+  m_update_pending = false;
+  update();
 }
 
+/// \internal
+/// Process pending coalesced input, if any.
 void
-QcMapGestureArea::set_pinch_state(const QcMapGestureArea::PinchState state)
+QcMapGestureArea::flush_pending_update()
 {
-  m_pinch_state = state;
+  if (!m_update_pending)
+    return;
+  m_update_pending = false;
+  update();
 }
 
 /// \internal
-bool
-QcMapGestureArea::is_active() const
+/// Polish runs on the GUI thread once per frame after the frame synchronous input
+/// delivery and before the map items are polished, thus the camera update issued
+/// here is visible in the same frame.
+void
+QcMapGestureArea::updatePolish()
 {
-  return is_pan_active() || is_pinch_active() || is_rotation_active() || is_tilt_active();
+  flush_pending_update();
 }
 
 /// \internal
@@ -1111,32 +1364,23 @@ QcMapGestureArea::update()
 {
   if (!m_map)
     return;
+  QElapsedTimer update_timer;
+  update_timer.start();
   // First state machine is for the number of touch points
 
   //combine touch with mouse event
-  m_all_points.clear();
-  m_all_points << m_touch_points;
-  if (m_all_points.isEmpty() && !m_mouse_point.isNull())
-    m_all_points << *m_mouse_point.data();
-  std::sort(
-    m_all_points.begin(),
-    m_all_points.end(),
-    [](const QTouchEvent::TouchPoint & tp1, const QTouchEvent::TouchPoint & tp2) { return tp1.id() < tp2.id(); });
+  m_all_points = m_touch_points;
+  if (m_all_points.isEmpty() && m_mouse_point)
+    m_all_points.append(*m_mouse_point);
+  m_all_points.sort_by_id();
 
-  touch_point_state_machine();
+  // Gather the camera changes of the state machines so that the map applies them at once
+  m_declarative_map->beginCameraUpdate();
 
-  // Parallel state machine for tilt. Tilt goes first as it blocks anything else, when started.
-  // But tilting can also only start if nothing else is active.
-  if (is_tilt_active() || m_pinch.m_tilt_enabled)
-    tilt_state_machine();
-
-  // Parallel state machine for pinch
-  if (is_pinch_active() || m_pinch.m_pinch_enabled)
-    pinch_state_machine();
+  touch_point_state_machine();
 
-  // Parallel state machine for rotation.
-  if (is_rotation_active() || m_pinch.m_rotation_enabled)
-    rotation_state_machine();
+  // Tilt, pinch and rotation, their conflicts are resolved by the arbiter
+  run_recognizers();
 
   // Parallel state machine for pan (since you can pan at the same time as pinching)
   // The stop_pan function ensures that pan stops immediately when disabled,
@@ -1146,6 +1390,65 @@ QcMapGestureArea::update()
   // properly rotate around the touch point centroid.
   if (is_pan_active() || m_flick.m_flick_enabled || m_flick.m_pan_enabled)
     pan_state_machine();
+
+  // an event which didn't move the camera, e.g. a press or a move below the drag threshold,
+  // is not a camera update
+  const bool camera_updated = m_declarative_map->commitCameraUpdate();
+  if (camera_updated) {
+    m_statistics.m_camera_updates++;
+    m_statistics.add_input_latency(m_input_timestamp);
+    m_declarative_map->tagCameraUpdate(m_input_timestamp); // for the input-to-photon latency
+  }
+
+  if (m_trace_buffer && camera_updated) {
+    const QGeoCoordinate & center = m_declarative_map->center();
+    m_trace_buffer->trace_camera(center.longitude(), center.latitude(), m_declarative_map->zoomLevel(),
+                                 m_declarative_map->bearing(), m_declarative_map->tilt());
+  }
+
+  m_statistics.add_update_time(update_timer.nsecsElapsed());
+}
+
+// Tilt goes first as it blocks anything else when started, but tilting can only start if
+// nothing else is active.
+const QcGestureRecognizer<QcMapGestureArea> QcMapGestureArea::s_recognizers[NumberOfRecognizers] = {
+  {
+    TiltRecognizer, PinchRecognizer | RotationRecognizer | TransformRecognizer, QcGestureTraceRecord::TiltMachine,
+    &QcMapGestureArea::tilt_enabled, &QcMapGestureArea::can_start_tilt,
+    &QcMapGestureArea::start_tilt, &QcMapGestureArea::update_tilt, &QcMapGestureArea::end_tilt,
+    &QcMapGestureArea::tilt_activeChanged
+  },
+  {
+    PinchRecognizer, TiltRecognizer, QcGestureTraceRecord::PinchMachine,
+    &QcMapGestureArea::separate_pinch_enabled, &QcMapGestureArea::can_start_pinch,
+    &QcMapGestureArea::start_pinch, &QcMapGestureArea::update_pinch, &QcMapGestureArea::end_pinch,
+    &QcMapGestureArea::pinch_activeChanged
+  },
+  {
+    RotationRecognizer, TiltRecognizer, QcGestureTraceRecord::RotationMachine,
+    &QcMapGestureArea::separate_rotation_enabled, &QcMapGestureArea::can_start_rotation,
+    &QcMapGestureArea::start_rotation, &QcMapGestureArea::update_rotation, &QcMapGestureArea::end_rotation,
+    &QcMapGestureArea::rotation_activeChanged
+  },
+  {
+    TransformRecognizer, TiltRecognizer, QcGestureTraceRecord::TransformMachine,
+    &QcMapGestureArea::transform_enabled, &QcMapGestureArea::can_start_transform,
+    &QcMapGestureArea::start_transform, &QcMapGestureArea::update_transform, &QcMapGestureArea::end_transform,
+    &QcMapGestureArea::pinch_activeChanged
+  },
+};
+
+/// \internal
+void
+QcMapGestureArea::run_recognizers()
+{
+  quint32 changed = m_arbiter.run(this, s_recognizers, m_all_points.count(), m_trace_buffer);
+  // grab once for all the recognizers, keep it while one of them is active
+  if (changed) {
+    bool keep_grab = m_arbiter.active() || m_prevent_stealing;
+    m_declarative_map->setKeepMouseGrab(keep_grab);
+    m_declarative_map->setKeepTouchGrab(keep_grab);
+  }
 }
 
 /// \internal
@@ -1155,6 +1458,11 @@ QcMapGestureArea::touch_point_state_machine()
   // Transitions:
   switch (m_touch_point_state) {
   case touch_points0:
+    // a new contact catches the zoom and rotation inertia, the flick is handled by the pan
+    if (m_all_points.count() >= 1) {
+      m_flick.m_scroller->stop_channels(QcKineticScroller::ZoomLevel | QcKineticScroller::Bearing);
+      cancel_prefetch();
+    }
     if (m_all_points.count() == 1) {
       clear_touch_data();
       start_one_touch_point();
@@ -1168,7 +1476,7 @@ QcMapGestureArea::touch_point_state_machine()
   case touch_points1:
     if (m_all_points.count() == 0) {
       set_touch_point_state(touch_points0);
-    } else if (m_all_points.count() == 2) {
+    } else if (m_all_points.count() >= 2) {
       m_touch_center_coordinate = m_declarative_map->toCoordinate(m_touch_pointsCentroid, false);
       start_two_touch_points();
       set_touch_point_state(touch_points2);
@@ -1181,6 +1489,13 @@ QcMapGestureArea::touch_point_state_machine()
       m_touch_center_coordinate = m_declarative_map->toCoordinate(m_touch_pointsCentroid, false);
       start_one_touch_point();
       set_touch_point_state(touch_points1);
+    } else if (!m_touch_geometry.has_same_points(m_all_points)) {
+      // a finger was added or lifted, the centroid jumps: restart the pan from it
+      QcVectorDouble previous_centroid = m_touch_pointsCentroid;
+      m_touch_center_coordinate = m_declarative_map->toCoordinate(previous_centroid, false);
+      start_two_touch_points();
+      m_pinch.m_tilt.m_start_touch_centroid += m_touch_geometry.centroid() - previous_centroid;
+      m_touch_pointsCentroid = m_touch_geometry.centroid();
     }
     break;
   };
@@ -1202,9 +1517,11 @@ QcMapGestureArea::touch_point_state_machine()
 void
 QcMapGestureArea::start_one_touch_point()
 {
-  m_scene_start_point1 = mapFromScene(m_all_points.at(0).scenePosition());
-  m_last_position = m_scene_start_point1;
-  m_last_position_time.start();
+  m_scene_start_point1 = mapFromScene(m_all_points.at(0).scene_position());
+  m_touch_geometry.clear();
+  m_velocity_tracker.clear();
+  m_velocity_tracker.add_sample(m_all_points.at(0).timestamp(), m_scene_start_point1);
+  m_resampler.reset();
   QGeoCoordinate startCoord = m_declarative_map->toCoordinate(m_scene_start_point1, false);
   // ensures a smooth transition for panning
   m_start_coordinate.setLongitude(m_start_coordinate.longitude() + startCoord.longitude() - m_touch_center_coordinate.longitude());
@@ -1215,96 +1532,45 @@ QcMapGestureArea::start_one_touch_point()
 void
 QcMapGestureArea::update_one_touch_point()
 {
-  m_touch_pointsCentroid = mapFromScene(m_all_points.at(0).scenePos());
-  update_flick_parameters(m_touch_pointsCentroid);
+  m_touch_pointsCentroid = mapFromScene(m_all_points.at(0).scene_position());
 }
 
 /// \internal
 void
 QcMapGestureArea::start_two_touch_points()
 {
-  m_scene_start_point1 = mapFromScene(m_all_points.at(0).scenePos());
-  m_scene_start_point2 = mapFromScene(m_all_points.at(1).scenePos());
-  QcVectorDouble startPos = (m_scene_start_point1 + m_scene_start_point2) * 0.5;
-  m_last_position = startPos;
-  m_last_position_time.start();
+  m_scene_start_point1 = mapFromScene(m_all_points.at(0).scene_position());
+  m_scene_start_point2 = mapFromScene(m_all_points.at(1).scene_position());
+  update_touch_geometry();
+  QcVectorDouble startPos = m_touch_geometry.centroid();
+  m_velocity_tracker.clear();
+  m_velocity_tracker.add_sample(m_touch_geometry.timestamp(), startPos);
+  m_resampler.reset();
   QGeoCoordinate startCoord = m_declarative_map->toCoordinate(startPos, false);
   m_start_coordinate.setLongitude(m_start_coordinate.longitude() + startCoord.longitude() - m_touch_center_coordinate.longitude());
   m_start_coordinate.setLatitude(m_start_coordinate.latitude() + startCoord.latitude() - m_touch_center_coordinate.latitude());
-  m_two_touch_angle_start = touch_angle(m_scene_start_point1, m_scene_start_point2); // Initial angle used for calculating rotation
-  m_distance_between_touch_points_start = distance_between_touch_points(m_scene_start_point1, m_scene_start_point2);
-  m_two_touch_points_centroid_start = (m_scene_start_point1 + m_scene_start_point2) / 2;
+  m_two_touch_angle_start = m_touch_geometry.angle(); // Initial angle used for calculating rotation
+  m_distance_between_touch_points_start = m_touch_geometry.spread();
+  m_two_touch_points_centroid_start = startPos;
 }
 
 /// \internal
 void
 QcMapGestureArea::update_two_touch_points()
 {
-  QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scenePos());
-  QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scenePos());
-  m_distance_between_touch_points = distance_between_touch_points(p1, p2);
-  m_touch_pointsCentroid = (p1 + p2) / 2;
-  update_flick_parameters(m_touch_pointsCentroid);
-
-  m_two_touch_angle = touch_angle(p1, p2);
+  update_touch_geometry();
+  m_distance_between_touch_points = m_touch_geometry.spread();
+  m_touch_pointsCentroid = m_touch_geometry.centroid();
+  m_two_touch_angle = m_touch_geometry.angle();
 }
 
 /// \internal
 void
-QcMapGestureArea::tilt_state_machine()
+QcMapGestureArea::update_touch_geometry()
 {
-  TiltState lastState = m_tilt_state;
-  // Transitions:
-  switch (m_tilt_state) {
-  case tilt_inactive:
-    if (m_all_points.count() >= 2) {
-      if (!is_rotation_active() && !is_pinch_active() && can_start_tilt()) { // only gesture that can be overridden: pan/flick
-        m_declarative_map->setKeepMouseGrab(true);
-        m_declarative_map->setKeepTouchGrab(true);
-        start_tilt();
-        set_tilt_state(tilt_active);
-      } else {
-        set_tilt_state(tilt_inactive_two_points);
-      }
-    }
-    break;
-  case tilt_inactive_two_points:
-    if (m_all_points.count() <= 1) {
-      set_tilt_state(tilt_inactive);
-    } else {
-      if (!is_rotation_active() && !is_pinch_active() && can_start_tilt()) { // only gesture that can be overridden: pan/flick
-        m_declarative_map->setKeepMouseGrab(true);
-        m_declarative_map->setKeepTouchGrab(true);
-        start_tilt();
-        set_tilt_state(tilt_active);
-      }
-    }
-    break;
-  case tilt_active:
-    if (m_all_points.count() <= 1) {
-      set_tilt_state(tilt_inactive);
-      m_declarative_map->setKeepMouseGrab(m_prevent_stealing);
-      m_declarative_map->setKeepTouchGrab(m_prevent_stealing);
-      end_tilt();
-    }
-    break;
-  }
-  // This line implements an exclusive state machine, where the transitions and updates don't
-  // happen on the same frame
-  if (m_tilt_state != lastState) {
-    emit tilt_activeChanged();
-    return;
-  }
-
-  // Update
-  switch (m_tilt_state) {
-  case tilt_inactive:
-  case tilt_inactive_two_points:
-    break; // do nothing
-  case tilt_active:
-    update_tilt();
-    break;
-  }
+  m_touch_geometry.update(m_all_points, [this](const QcTouchPoint & point) {
+      return QcVectorDouble(mapFromScene(point.scene_position()));
+    });
 }
 
 bool
@@ -1317,9 +1583,12 @@ validateTouchAngleForTilting(const qreal angle)
 bool
 QcMapGestureArea::can_start_tilt()
 {
+  if (m_three_finger_drag != NoThreeFingerDrag)
+    return can_start_three_finger_drag();
+
   if (m_all_points.count() >= 2) {
-    QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scenePos());
-    QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scenePos());
+    QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scene_position());
+    QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scene_position());
     if (validateTouchAngleForTilting(m_two_touch_angle) && moving_parallel_vertical(m_scene_start_point1, p1, m_scene_start_point2, p2)
         && qAbs(m_two_touch_points_centroid_start.y() - m_touch_pointsCentroid.y()) > MinimumPanToTiltDelta) {
       m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
@@ -1335,6 +1604,33 @@ QcMapGestureArea::can_start_tilt()
   return false;
 }
 
+/// \internal
+bool
+QcMapGestureArea::can_start_three_finger_drag()
+{
+  // Single pass on the touch geometry: the centroid translates while the spread and the angle
+  // don't change, the fingers are moving together
+  if (m_all_points.count() < 3)
+    return false;
+
+  QcVectorDouble translation = m_touch_pointsCentroid - m_two_touch_points_centroid_start;
+  qreal distance = m_three_finger_drag == TiltDrag ? qAbs(translation.y()) : translation.magnitude();
+  if (distance < MinimumThreeFingerDragDelta)
+    return false;
+  if (qAbs(m_distance_between_touch_points - m_distance_between_touch_points_start) > distance / 2
+      || qAbs(angle_delta(m_two_touch_angle, m_two_touch_angle_start)) > MinimumRotationStartingAngle)
+    return false;
+
+  m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
+  m_pinch.m_event.set_angle(m_two_touch_angle);
+  m_pinch.m_event.set_point1(mapFromScene(m_all_points.at(0).scene_position()));
+  m_pinch.m_event.set_point2(mapFromScene(m_all_points.at(1).scene_position()));
+  m_pinch.m_event.set_number_of_points(m_all_points.count());
+  m_pinch.m_event.set_accepted(true);
+  emit tilt_started(&m_pinch.m_event);
+  return m_pinch.m_event.accepted();
+}
+
 /// \internal
 void
 QcMapGestureArea::start_tilt()
@@ -1346,6 +1642,7 @@ QcMapGestureArea::start_tilt()
 
   m_pinch.m_tilt.m_start_touch_centroid = m_touch_pointsCentroid;
   m_pinch.m_tilt.m_start_tilt = m_declarative_map->tilt();
+  m_pinch.m_tilt.m_start_bearing = m_declarative_map->bearing();
 }
 
 /// \internal
@@ -1353,17 +1650,21 @@ void
 QcMapGestureArea::update_tilt()
 {
   // Calculate the new tilt
-  qreal verticalDisplacement = (m_touch_pointsCentroid - m_pinch.m_tilt.m_start_touch_centroid).y();
+  QcVectorDouble displacement = m_touch_pointsCentroid - m_pinch.m_tilt.m_start_touch_centroid;
 
-  // Approach: 10pixel = 1 degree.
-  qreal tilt = verticalDisplacement / 10.0;
+  qreal tilt = displacement.y() * TiltRate;
   qreal newTilt = m_pinch.m_tilt.m_start_tilt - tilt;
   m_declarative_map->setTilt(newTilt);
 
+  if (m_three_finger_drag == TiltAndBearingDrag) {
+    qreal newBearing = m_pinch.m_tilt.m_start_bearing + displacement.x() * ThreeFingerBearingRate;
+    m_declarative_map->setBearing(newBearing);
+  }
+
   m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
   m_pinch.m_event.set_angle(m_two_touch_angle);
-  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scenePos());
-  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scenePos());
+  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scene_position());
+  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scene_position());
   m_pinch.m_event.set_point1(m_pinch.m_last_point1);
   m_pinch.m_event.set_point2(m_pinch.m_last_point2);
   m_pinch.m_event.set_number_of_points(m_all_points.count());
@@ -1387,71 +1688,16 @@ QcMapGestureArea::end_tilt()
   emit tilt_finished(&m_pinch.m_event);
 }
 
-/// \internal
-void
-QcMapGestureArea::rotation_state_machine()
-{
-  RotationState lastState = m_rotation_state;
-  // Transitions:
-  switch (m_rotation_state) {
-  case RotationInactive:
-    if (m_all_points.count() >= 2) {
-      if (!is_tilt_active() && can_start_rotation()) {
-        m_declarative_map->setKeepMouseGrab(true);
-        m_declarative_map->setKeepTouchGrab(true);
-        start_rotation();
-        set_rotation_state(rotation_active);
-      } else {
-        set_rotation_state(RotationInactiveTwoPoints);
-      }
-    }
-    break;
-  case RotationInactiveTwoPoints:
-    if (m_all_points.count() <= 1) {
-      set_rotation_state(RotationInactive);
-    } else {
-      if (!is_tilt_active() && can_start_rotation()) {
-        m_declarative_map->setKeepMouseGrab(true);
-        m_declarative_map->setKeepTouchGrab(true);
-        start_rotation();
-        set_rotation_state(rotation_active);
-      }
-    }
-    break;
-  case rotation_active:
-    if (m_all_points.count() <= 1) {
-      set_rotation_state(RotationInactive);
-      m_declarative_map->setKeepMouseGrab(m_prevent_stealing);
-      m_declarative_map->setKeepTouchGrab(m_prevent_stealing);
-      end_rotation();
-    }
-    break;
-  }
-  // This line implements an exclusive state machine, where the transitions and updates don't
-  // happen on the same frame
-  if (m_rotation_state != lastState) {
-    emit rotation_activeChanged();
-    return;
-  }
-
-  // Update
-  switch (m_rotation_state) {
-  case RotationInactive:
-  case RotationInactiveTwoPoints:
-    break; // do nothing
-  case rotation_active:
-    update_rotation();
-    break;
-  }
-}
-
 /// \internal
 bool
 QcMapGestureArea::can_start_rotation()
 {
+  if (m_three_finger_drag != NoThreeFingerDrag && m_all_points.count() >= 3)
+    return false;
+
   if (m_all_points.count() >= 2) {
-    QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scenePos());
-    QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scenePos());
+    QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scene_position());
+    QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scene_position());
     if (point_dragged(m_scene_start_point1, p1) || point_dragged(m_scene_start_point2, p2)) {
       qreal delta = angle_delta(m_two_touch_angle_start, m_two_touch_angle);
       if (qAbs(delta) < MinimumRotationStartingAngle) {
@@ -1477,6 +1723,8 @@ QcMapGestureArea::start_rotation()
   m_pinch.m_rotation.m_start_bearing = m_declarative_map->bearing();
   m_pinch.m_rotation.m_previous_touch_angle = m_two_touch_angle;
   m_pinch.m_rotation.m_total_angle = 0.0;
+  m_pinch.m_rotation.m_velocity_tracker.clear();
+  m_pinch.m_rotation.m_velocity_tracker.add_sample(m_input_timestamp, QcVectorDouble());
 }
 
 /// \internal
@@ -1485,6 +1733,8 @@ QcMapGestureArea::update_rotation()
 {
   // Calculate the new bearing
   qreal angle = angle_delta(m_pinch.m_rotation.m_previous_touch_angle, m_two_touch_angle);
+  m_pinch.m_rotation.m_velocity_tracker.add_sample(m_input_timestamp,
+                                                   QcVectorDouble(m_pinch.m_rotation.m_total_angle + angle, 0));
   if (qAbs(angle) < 0.2) // avoiding too many updates
     return;
 
@@ -1495,8 +1745,8 @@ QcMapGestureArea::update_rotation()
 
   m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
   m_pinch.m_event.set_angle(m_two_touch_angle);
-  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scenePos());
-  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scenePos());
+  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scene_position());
+  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scene_position());
   m_pinch.m_event.set_point1(m_pinch.m_last_point1);
   m_pinch.m_event.set_point2(m_pinch.m_last_point2);
   m_pinch.m_event.set_number_of_points(m_all_points.count());
@@ -1518,63 +1768,20 @@ QcMapGestureArea::end_rotation()
   m_pinch.m_event.set_accepted(true);
   m_pinch.m_event.set_number_of_points(0);
   emit rotation_finished(&m_pinch.m_event);
+
+  start_bearing_inertia();
 }
 
 /// \internal
 void
-QcMapGestureArea::pinch_state_machine()
-{
-  PinchState lastState = m_pinch_state;
-  // Transitions:
-  switch (m_pinch_state) {
-  case PinchInactive:
-    if (m_all_points.count() >= 2) {
-      if (!is_tilt_active() && can_start_pinch()) {
-        m_declarative_map->setKeepMouseGrab(true);
-        m_declarative_map->setKeepTouchGrab(true);
-        start_pinch();
-        set_pinch_state(pinch_active);
-      } else {
-        set_pinch_state(PinchInactiveTwoPoints);
-      }
-    }
-    break;
-  case PinchInactiveTwoPoints:
-    if (m_all_points.count() <= 1) {
-      set_pinch_state(PinchInactive);
-    } else {
-      if (!is_tilt_active() && can_start_pinch()) {
-        m_declarative_map->setKeepMouseGrab(true);
-        m_declarative_map->setKeepTouchGrab(true);
-        start_pinch();
-        set_pinch_state(pinch_active);
-      }
-    }
-    break;
-  case pinch_active:
-    if (m_all_points.count() <= 1) { // Once started, pinch goes off only when finger(s) are release
-      set_pinch_state(PinchInactive);
-      m_declarative_map->setKeepMouseGrab(m_prevent_stealing);
-      m_declarative_map->setKeepTouchGrab(m_prevent_stealing);
-      end_pinch();
-    }
-    break;
-  }
-  // This line implements an exclusive state machine, where the transitions and updates don't
-  // happen on the same frame
-  if (m_pinch_state != lastState) {
-    emit pinch_activeChanged();
-    return;
-  }
-
-  // Update
-  switch (m_pinch_state) {
-  case PinchInactive:
-  case PinchInactiveTwoPoints:
-    break; // do nothing
-  case pinch_active:
-    update_pinch();
-    break;
+QcMapGestureArea::start_bearing_inertia()
+{
+  // continue the rotation, the tracker returns a null velocity if the fingers paused
+  qreal angular_velocity = m_pinch.m_rotation.m_velocity_tracker.velocity(m_input_timestamp).x();
+  if ((m_accepted_gestures & RotationGesture) && qAbs(angular_velocity) > MinimumBearingInertiaRate) {
+    angular_velocity = qBound(-MaximumBearingInertiaRate, angular_velocity, MaximumBearingInertiaRate);
+    m_flick.m_scroller->fling_bearing(m_declarative_map->bearing(), -angular_velocity);
+    prefetch_predicted_camera();
   }
 }
 
@@ -1582,9 +1789,12 @@ QcMapGestureArea::pinch_state_machine()
 bool
 QcMapGestureArea::can_start_pinch()
 {
+  if (m_three_finger_drag != NoThreeFingerDrag && m_all_points.count() >= 3)
+    return false;
+
   if (m_all_points.count() >= 2) {
-    QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scenePos());
-    QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scenePos());
+    QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scene_position());
+    QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scene_position());
     if (qAbs(m_distance_between_touch_points - m_distance_between_touch_points_start) > MinimumPinchDelta) {
       m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
       m_pinch.m_event.set_angle(m_two_touch_angle);
@@ -1607,10 +1817,12 @@ QcMapGestureArea::start_pinch()
   m_pinch.m_zoom.m_previous = m_declarative_map->zoomLevel();
   m_pinch.m_last_angle = m_two_touch_angle;
 
-  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scenePos());
-  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scenePos());
+  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scene_position());
+  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scene_position());
 
   m_pinch.m_zoom.m_start = m_declarative_map->zoomLevel();
+  m_pinch.m_zoom.m_velocity_tracker.clear();
+  m_pinch.m_zoom.m_velocity_tracker.add_sample(m_input_timestamp, QcVectorDouble(m_pinch.m_zoom.m_start, 0));
 }
 
 /// \internal
@@ -1633,8 +1845,8 @@ QcMapGestureArea::update_pinch()
   m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
   m_pinch.m_event.set_angle(m_two_touch_angle);
 
-  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scenePos());
-  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scenePos());
+  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scene_position());
+  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scene_position());
   m_pinch.m_event.set_point1(m_pinch.m_last_point1);
   m_pinch.m_event.set_point2(m_pinch.m_last_point2);
   m_pinch.m_event.set_number_of_points(m_all_points.count());
@@ -1650,6 +1862,7 @@ QcMapGestureArea::update_pinch()
     newZoomLevel = qMin(qMax(perPinchMinimumZoomLevel, newZoomLevel), perPinchMaximumZoomLevel);
     m_declarative_map->setZoomLevel(qMin<qreal>(newZoomLevel, maximum_zoom_level()), false);
     m_pinch.m_zoom.m_previous = newZoomLevel;
+    m_pinch.m_zoom.m_velocity_tracker.add_sample(m_input_timestamp, QcVectorDouble(newZoomLevel, 0));
   }
 }
 
@@ -1667,6 +1880,153 @@ QcMapGestureArea::end_pinch()
   m_pinch.m_event.set_number_of_points(0);
   emit pinch_finished(&m_pinch.m_event);
   m_pinch.m_start_distance = 0;
+
+  start_zoom_inertia();
+}
+
+/// \internal
+void
+QcMapGestureArea::start_zoom_inertia()
+{
+  // continue the zoom within the zoom interval, the tracker returns a null velocity if the
+  // fingers paused
+  qreal zoom_rate = m_pinch.m_zoom.m_velocity_tracker.velocity(m_input_timestamp).x();
+  if ((m_accepted_gestures & PinchGesture) && qAbs(zoom_rate) > MinimumZoomInertiaRate) {
+    zoom_rate = qBound(-MaximumZoomInertiaRate, zoom_rate, MaximumZoomInertiaRate);
+    qreal minimum = m_pinch.m_zoom.m_interval.inf();
+    qreal maximum = qMin<qreal>(m_pinch.m_zoom.m_interval.sup(), maximum_zoom_level());
+    // the coordinate under the fingers stays under them, as during the pinch
+    m_pinch.m_zoom.m_anchor_point = m_touch_pointsCentroid;
+    m_pinch.m_zoom.m_anchor = coordinate_to_mercator(m_declarative_map->toCoordinate(m_touch_pointsCentroid, false));
+    m_flick.m_scroller->fling_zoom_level(m_declarative_map->zoomLevel(), zoom_rate, minimum, maximum);
+    prefetch_predicted_camera();
+  }
+}
+
+/// \internal
+bool
+QcMapGestureArea::transform_enabled() const
+{
+  return m_direct_manipulation && (pinch_enabled() || rotation_enabled());
+}
+
+/// \internal
+bool
+QcMapGestureArea::separate_pinch_enabled() const
+{
+  return !m_direct_manipulation && pinch_enabled();
+}
+
+/// \internal
+bool
+QcMapGestureArea::separate_rotation_enabled() const
+{
+  return !m_direct_manipulation && rotation_enabled();
+}
+
+/// \internal
+bool
+QcMapGestureArea::can_start_transform()
+{
+  if (m_three_finger_drag != NoThreeFingerDrag && m_all_points.count() >= 3)
+    return false;
+
+  if (m_all_points.count() >= 2) {
+    QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scene_position());
+    QcVectorDouble p2 = mapFromScene(m_all_points.at(1).scene_position());
+    // same thresholds than the pinch and the rotation
+    bool scaled = pinch_enabled()
+      && qAbs(m_distance_between_touch_points - m_distance_between_touch_points_start) > MinimumPinchDelta;
+    bool rotated = rotation_enabled()
+      && (point_dragged(m_scene_start_point1, p1) || point_dragged(m_scene_start_point2, p2))
+      && qAbs(angle_delta(m_two_touch_angle_start, m_two_touch_angle)) >= MinimumRotationStartingAngle;
+    if (scaled || rotated) {
+      m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
+      m_pinch.m_event.set_angle(m_two_touch_angle);
+      m_pinch.m_event.set_point1(p1);
+      m_pinch.m_event.set_point2(p2);
+      m_pinch.m_event.set_number_of_points(m_all_points.count());
+      m_pinch.m_event.set_accepted(true);
+      emit pinch_started(&m_pinch.m_event);
+      return m_pinch.m_event.accepted();
+    }
+  }
+  return false;
+}
+
+/// \internal
+void
+QcMapGestureArea::start_transform()
+{
+  start_pinch();
+  start_rotation();
+  // the coordinate under the touch centroid stays under it, the pan uses the same anchor
+  m_start_coordinate = m_declarative_map->toCoordinate(m_touch_pointsCentroid, false);
+}
+
+/// \internal
+void
+QcMapGestureArea::update_transform()
+{
+  // The camera changes are gathered by the camera update of update(), they are applied at once
+
+  // Rotation, accumulated so as to cross the +- 180 edge
+  qreal angle = angle_delta(m_pinch.m_rotation.m_previous_touch_angle, m_two_touch_angle);
+  m_pinch.m_rotation.m_previous_touch_angle = m_two_touch_angle;
+  m_pinch.m_rotation.m_total_angle += angle;
+  if (rotation_enabled()) {
+    m_declarative_map->setBearing(m_pinch.m_rotation.m_start_bearing - m_pinch.m_rotation.m_total_angle);
+    m_pinch.m_rotation.m_velocity_tracker.add_sample(m_input_timestamp,
+                                                     QcVectorDouble(m_pinch.m_rotation.m_total_angle, 0));
+  }
+
+  // Scale, the scale doubles for each zoom level
+  if (pinch_enabled() && (m_accepted_gestures & PinchGesture)
+      && m_pinch.m_start_distance > 0 && m_distance_between_touch_points > 0) {
+    qreal newZoomLevel = m_pinch.m_zoom.m_start + std::log2(m_distance_between_touch_points / m_pinch.m_start_distance);
+    qreal perPinchMinimumZoomLevel = qMax<qreal>(m_pinch.m_zoom.m_start - m_pinch.m_zoom.maximum_change, m_pinch.m_zoom.m_interval.inf());
+    qreal perPinchMaximumZoomLevel = qMin<qreal>(m_pinch.m_zoom.m_start + m_pinch.m_zoom.maximum_change, m_pinch.m_zoom.m_interval.sup());
+    newZoomLevel = qMin(qMax(perPinchMinimumZoomLevel, newZoomLevel), perPinchMaximumZoomLevel);
+    m_declarative_map->setZoomLevel(qMin<qreal>(newZoomLevel, maximum_zoom_level()), false);
+    m_pinch.m_zoom.m_previous = newZoomLevel;
+    m_pinch.m_zoom.m_velocity_tracker.add_sample(m_input_timestamp, QcVectorDouble(newZoomLevel, 0));
+  }
+
+  // Translation, anchored at the touch centroid with the pending zoom level and bearing
+  m_declarative_map->alignCoordinateToPoint(m_start_coordinate, m_touch_pointsCentroid);
+
+  m_pinch.m_event.set_center(mapFromScene(m_touch_pointsCentroid));
+  m_pinch.m_event.set_angle(m_two_touch_angle);
+  m_pinch.m_last_point1 = mapFromScene(m_all_points.at(0).scene_position());
+  m_pinch.m_last_point2 = mapFromScene(m_all_points.at(1).scene_position());
+  m_pinch.m_event.set_point1(m_pinch.m_last_point1);
+  m_pinch.m_event.set_point2(m_pinch.m_last_point2);
+  m_pinch.m_event.set_number_of_points(m_all_points.count());
+  m_pinch.m_event.set_accepted(true);
+
+  m_pinch.m_last_angle = m_two_touch_angle;
+  emit pinch_updated(&m_pinch.m_event);
+}
+
+/// \internal
+void
+QcMapGestureArea::end_transform()
+{
+  QcVectorDouble p1 = mapFromScene(m_pinch.m_last_point1);
+  QcVectorDouble p2 = mapFromScene(m_pinch.m_last_point2);
+  m_pinch.m_event.set_center((p1 + p2) / 2);
+  m_pinch.m_event.set_angle(m_pinch.m_last_angle);
+  m_pinch.m_event.set_point1(p1);
+  m_pinch.m_event.set_point2(p2);
+  m_pinch.m_event.set_accepted(true);
+  m_pinch.m_event.set_number_of_points(0);
+  emit pinch_finished(&m_pinch.m_event);
+  m_pinch.m_start_distance = 0;
+
+  if (pinch_enabled())
+    start_zoom_inertia();
+  if (rotation_enabled())
+    start_bearing_inertia();
 }
 
 /// \internal
@@ -1689,10 +2049,15 @@ QcMapGestureArea::pan_state_machine()
     break;
   case pan_active:
     if (m_all_points.count() == 0) {
+      // the resampled centroid is extrapolated, the map must rest under the lifted finger
+      if (m_resampler.is_enabled()) {
+        m_resample_timer.stop();
+        m_declarative_map->alignCoordinateToPoint(m_start_coordinate, m_touch_pointsCentroid);
+      }
       if (!try_start_flick()) {
         set_flick_state(flick_inactive);
         // mark as inactive for use by camera
-        if (m_pinch_state == PinchInactive && m_rotation_state == RotationInactive && m_tilt_state == tilt_inactive) {
+        if (!m_arbiter.active()) {
           m_declarative_map->setKeepMouseGrab(m_prevent_stealing);
           m_map->prefetchData();
         }
@@ -1706,7 +2071,13 @@ QcMapGestureArea::pan_state_machine()
     break;
   case flick_active:
     if (m_all_points.count() > 0) { // re touched before movement ended
-      stop_flick();
+      // take over the scrolling without the stop/start cycle of the pan
+      m_flick.m_scroller->stop_channels(QcKineticScroller::Position);
+      m_statistics.m_flicks_aborted++;
+      m_flick_vector = QVector2D();
+      if (m_trace_buffer)
+        m_trace_buffer->trace_flick_stop();
+      emit flick_finished();
       m_declarative_map->setKeepMouseGrab(true);
       set_flick_state(pan_active);
     }
@@ -1721,7 +2092,9 @@ QcMapGestureArea::pan_state_machine()
   case flick_inactive: // do nothing
     break;
   case pan_active:
-    update_pan();
+    // the transform already anchored the map at the touch centroid
+    if (!m_arbiter.is_active(TransformRecognizer))
+      update_pan();
     // this ensures 'pan_started' occurs after the pan has actually started
     if (lastState != pan_active)
       emit pan_started();
@@ -1743,7 +2116,7 @@ QcMapGestureArea::can_start_pan()
   // Check if thresholds for normal panning are met.
   // (normal panning vs flicking: flicking will start from mouse release event).
   const int start_drag_distance = qApp->styleHints()->start_drag_distance() * 2;
-  QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scenePos());
+  QcVectorDouble p1 = mapFromScene(m_all_points.at(0).scene_position());
   int dyFromPress = int(p1.y() - m_scene_start_point1.y());
   int dxFromPress = int(p1.x() - m_scene_start_point1.x());
   if ((qAbs(dyFromPress) >= start_drag_distance || qAbs(dxFromPress) >= start_drag_distance))
@@ -1755,7 +2128,27 @@ QcMapGestureArea::can_start_pan()
 void
 QcMapGestureArea::update_pan()
 {
+  if (m_resampler.is_enabled()) {
+    m_declarative_map->alignCoordinateToPoint(m_start_coordinate, m_resampler.resample());
+    // no more samples means that the finger paused
+    m_resample_timer.start(m_resampler.pause_interval());
+  } else
+    m_declarative_map->alignCoordinateToPoint(m_start_coordinate, m_touch_pointsCentroid);
+}
+
+/// \internal
+/// The finger paused, the extrapolation of the last update would overshoot,
+/// thus the map is realigned to the raw centroid.
+void
+QcMapGestureArea::handle_resample_timer_timeout()
+{
+  if (m_flick_state != pan_active)
+    return;
+
+  m_declarative_map->beginCameraUpdate();
   m_declarative_map->alignCoordinateToPoint(m_start_coordinate, m_touch_pointsCentroid);
+  if (m_declarative_map->commitCameraUpdate())
+    m_statistics.m_camera_updates++;
 }
 
 /// \internal
@@ -1764,68 +2157,128 @@ QcMapGestureArea::try_start_flick()
 {
   if ((m_accepted_gestures & FlickGesture) == 0)
     return false;
-  // if we drag then pause before release we should not cause a flick.
-  qreal flickSpeed = 0.0;
-  if (m_last_position_time.elapsed() < QML_MAP_FLICK_VELOCITY_SAMPLE_PERIOD)
-    flickSpeed = m_flick_vector.length();
-
-  int flickTime = 0;
-  int flickPixels = 0;
-  QVector2D flickVector;
-
-  if (qAbs(flickSpeed) > MinimumFlickVelocity && distance_between_touch_points(m_touch_pointsCentroid, m_scene_start_point1) > FlickThreshold) {
-    qreal acceleration = m_flick.m_deceleration;
-    if ((flickSpeed > 0.0f) == (m_flick.m_deceleration > 0.0f))
-      acceleration = acceleration * -1.0f;
-    flickTime = static_cast<int>(-1000 * flickSpeed / acceleration);
-    flickPixels = (flickTime * flickSpeed) / 2000.0;
-    flickVector = m_flick_vector.normalized() * flickPixels;
-  }
-
-  if (flickTime > 0) {
-    start_flick(flickVector.x(), flickVector.y(), flickTime);
+  // if we drag then pause before release we should not cause a flick,
+  // the tracker returns a null velocity in this case.
+  const QcVectorDouble velocity = m_velocity_tracker.velocity(m_input_timestamp);
+  qreal flickSpeed = qMin<qreal>(velocity.magnitude(), m_flick.m_max_velocity);
+  m_flick_vector = QVector2D(velocity.x(), velocity.y()).normalized() * flickSpeed;
+
+  if (flickSpeed > MinimumFlickVelocity && distance_between_touch_points(m_touch_pointsCentroid, m_scene_start_point1) > FlickThreshold
+      && start_flick(QcVectorDouble(m_flick_vector.x(), m_flick_vector.y()))) {
+    m_statistics.m_flicks_started++;
+    if (m_trace_buffer)
+      m_trace_buffer->trace_flick_start(m_flick_vector.x(), m_flick_vector.y(), m_flick.m_scroller->remaining_time());
+    prefetch_predicted_camera();
     return true;
   }
   return false;
 }
 
 /// \internal
-void
-QcMapGestureArea::start_flick(int dx, int dy, int time_ms)
+bool
+QcMapGestureArea::start_flick(const QcVectorDouble & velocity)
 {
-  if (!m_flick.m_animation)
-    return;
-  if (time_ms < 0)
-    return;
+  if (!m_flick.m_scroller)
+    return false;
+
+  // Map the screen velocity to the Mercator space using the local Jacobian of the projection at
+  // the viewport center, thus the bearing and the tilt are accounted
+  QcVectorDouble center_point(m_declarative_map->width() * .5, m_declarative_map->height() * .5);
+  QGeoCoordinate center_coordinate = m_declarative_map->toCoordinate(center_point, false);
+  QGeoCoordinate dx_coordinate = m_declarative_map->toCoordinate(center_point + QcVectorDouble(1, 0), false);
+  QGeoCoordinate dy_coordinate = m_declarative_map->toCoordinate(center_point + QcVectorDouble(0, 1), false);
+  if (!center_coordinate.isValid() || !dx_coordinate.isValid() || !dy_coordinate.isValid())
+    return false;
 
-  QGeoCoordinate animationStartCoordinate = m_declarative_map->center();
+  QcVectorDouble center = coordinate_to_mercator(center_coordinate);
+  QcVectorDouble jx = coordinate_to_mercator(dx_coordinate) - center;
+  QcVectorDouble jy = coordinate_to_mercator(dy_coordinate) - center;
+  // the offset can cross the antimeridian
+  jx = QcVectorDouble(jx.x() - std::round(jx.x()), jx.y());
+  jy = QcVectorDouble(jy.x() - std::round(jy.x()), jy.y());
 
-  if (m_flick.m_animation->isRunning())
-    m_flick.m_animation->stop();
-  QGeoCoordinate animationEndCoordinate = m_declarative_map->center();
-  m_flick.m_animation->setDuration(time_ms);
+  // the camera moves in the opposite direction of the finger
+  QcVectorDouble mercator_velocity = (jx * velocity.x() + jy * velocity.y()) * -1.;
+  double deceleration = m_flick.m_deceleration * mercator_velocity.magnitude() / velocity.magnitude();
 
-  QcVectorDouble delta(dx, dy);
-  QMatrix4x4 matBearing;
-  matBearing.rotate(m_map->cameraData().bearing(), 0, 0, 1);
-  delta = matBearing * delta;
+  m_flick.m_scroller->fling(coordinate_to_mercator(m_declarative_map->center()), mercator_velocity, deceleration);
+  m_flick.m_position = m_flick.m_scroller->position();
+  return true;
+}
 
-  double zoom = pow(2.0, m_declarative_map->zoomLevel());
-  double longitude = animationStartCoordinate.longitude() - (delta.x() / zoom);
-  double latitude = animationStartCoordinate.latitude() + (delta.y() / zoom);
+/// \internal
+void
+QcMapGestureArea::prefetch_predicted_camera()
+{
+  // Publish where the inertia ends, so that the map loads the tiles while the camera moves.
+  // The declarative getters account the camera changes of a pending camera update, unlike
+  // the camera of the map.
+  QGeoCameraData camera_data;
+  camera_data.setCenter(m_declarative_map->center());
+  camera_data.setZoomLevel(m_declarative_map->zoomLevel());
+  camera_data.setBearing(m_declarative_map->bearing());
+  camera_data.setTilt(m_declarative_map->tilt());
+  camera_data.setFieldOfView(m_declarative_map->fieldOfView());
+  if (m_flick.m_scroller->is_active(QcKineticScroller::Position))
+    camera_data.setCenter(mercator_to_coordinate(m_flick.m_scroller->predicted_position()));
+  if (m_flick.m_scroller->is_active(QcKineticScroller::ZoomLevel))
+    camera_data.setZoomLevel(m_flick.m_scroller->predicted_zoom_level());
+  if (m_flick.m_scroller->is_active(QcKineticScroller::Bearing))
+    camera_data.setBearing(m_flick.m_scroller->predicted_bearing());
+
+  // the new prediction supersedes the previous one
+  cancel_prefetch();
+  m_prefetch_id = m_declarative_map->prefetchCameraPath({camera_data}, m_flick.m_scroller->time_to_rest(),
+                                                        QcMapItem::HighPrefetchPriority);
+}
 
-  if (delta.x() > 0)
-    m_flick.m_animation->setDirection(QcGeoCoordinateAnimation::East);
-  else
-    m_flick.m_animation->setDirection(QcGeoCoordinateAnimation::West);
+/// \internal
+void
+QcMapGestureArea::cancel_prefetch()
+{
+  if (m_prefetch_id)
+    m_declarative_map->cancelPrefetch(m_prefetch_id);
+  m_prefetch_id = 0;
+}
 
-  // keep animation in correct bounds
-  animationEndCoordinate.setLongitude(QLocationUtils::wrapLong(longitude));
-  animationEndCoordinate.setLatitude(QLocationUtils::clipLat(latitude, QLocationUtils::mercatorMaxLatitude()));
+/// \internal
+void
+QcMapGestureArea::handle_scroller_updated(QcKineticScroller::Channels channels)
+{
+  // one camera update per animation frame
+  m_declarative_map->beginCameraUpdate();
+  if (channels & QcKineticScroller::ZoomLevel)
+    m_declarative_map->setZoomLevel(m_flick.m_scroller->zoom_level(), false);
+  if (channels & QcKineticScroller::Bearing)
+    m_declarative_map->setBearing(m_flick.m_scroller->bearing());
+  if (channels & QcKineticScroller::Position) {
+    // The flick is applied as a displacement, since the zoom anchoring moves the center too,
+    // the displacement can cross the antimeridian
+    QcVectorDouble delta = m_flick.m_scroller->position() - m_flick.m_position;
+    delta = QcVectorDouble(delta.x() - std::round(delta.x()), delta.y());
+    m_flick.m_position = m_flick.m_scroller->position();
+    if (channels & QcKineticScroller::ZoomLevel)
+      // the map slides under the anchor point
+      m_pinch.m_zoom.m_anchor = m_pinch.m_zoom.m_anchor + delta;
+    else
+      m_declarative_map->setCenter(mercator_to_coordinate(coordinate_to_mercator(m_declarative_map->center()) + delta));
+  }
+  // the zoom and the rotation are centered on the last touch centroid
+  if (channels & QcKineticScroller::ZoomLevel)
+    m_declarative_map->alignCoordinateToPoint(mercator_to_coordinate(m_pinch.m_zoom.m_anchor),
+                                              m_pinch.m_zoom.m_anchor_point);
+  if (m_declarative_map->commitCameraUpdate())
+    m_statistics.m_camera_updates++;
+}
 
-  m_flick.m_animation->setFrom(animationStartCoordinate);
-  m_flick.m_animation->setTo(animationEndCoordinate);
-  m_flick.m_animation->start();
+/// \internal
+void
+QcMapGestureArea::handle_scroller_finished(QcKineticScroller::Channels channels)
+{
+  if (channels & QcKineticScroller::Position)
+    handle_flick_animation_stopped();
+  if (!m_flick.m_scroller->active_channels())
+    cancel_prefetch();
 }
 
 void
@@ -1835,6 +2288,7 @@ QcMapGestureArea::stop_pan()
     stop_flick();
   } else if (m_flick_state == pan_active) {
     m_flick_vector = QVector2D();
+    m_resample_timer.stop();
     set_flick_state(flick_inactive);
     m_declarative_map->setKeepMouseGrab(m_prevent_stealing);
     emit pan_finished();
@@ -1847,13 +2301,13 @@ QcMapGestureArea::stop_pan()
 void
 QcMapGestureArea::stop_flick()
 {
-  if (!m_flick.m_animation)
+  if (!m_flick.m_scroller)
     return;
   m_flick_vector = QVector2D();
-  if (m_flick.m_animation->isRunning())
-    m_flick.m_animation->stop();
-  else
-    handle_flick_animation_stopped();
+  if (m_flick.m_scroller->is_active(QcKineticScroller::Position))
+    m_statistics.m_flicks_aborted++;
+  m_flick.m_scroller->stop_channels(QcKineticScroller::Position);
+  handle_flick_animation_stopped();
 }
 
 void
@@ -1861,6 +2315,8 @@ QcMapGestureArea::handle_flick_animation_stopped()
 {
   m_declarative_map->setKeepMouseGrab(m_prevent_stealing);
   if (m_flick_state == flick_active) {
+    if (m_trace_buffer)
+      m_trace_buffer->trace_flick_stop();
     set_flick_state(flick_inactive);
     emit flick_finished();
     emit pan_activeChanged();
@@ -71,16 +71,24 @@
 
 #include "coordinate/mercator.h"
 #include "coordinate/wgs84.h"
-#include "geo_coordinate_animation.h"
 #include "geometry/vector.h"
+#include "map_gesture_kinetic_scroller.h"
+#include "map_gesture_recognizer.h"
+#include "map_gesture_resampler.h"
+#include "map_gesture_statistics.h"
+#include "map_gesture_touch_point.h"
+#include "map_gesture_velocity_tracker.h"
 #include "math/interval.h"
 
+#include <optional>
+
 // #include <QtCore/QPointer>
 // #include <QtGui/QVector2D>
 // #include <QtPositioning/qgeocoordinate.h>
 
 #include <QDebug> // Fixme: QtDebug ???
 #include <QElapsedTimer>
+#include <QTimer>
 #include <QTouchEvent>
 #include <QtQuick/QQuickItem>
 
@@ -94,6 +102,8 @@
 // class QcGeoCoordinateAnimation;
 
 class QcMapItem;
+class QcGestureRecorder;
+class QcGestureTraceBuffer;
 
 /**************************************************************************************************/
 
@@ -199,6 +209,9 @@ class QcMapGestureArea : public QQuickItem
 {
   Q_OBJECT
   Q_ENUMS(GeoMapGesture)
+  Q_ENUMS(UpdateMode)
+  Q_ENUMS(VelocityEstimator)
+  Q_ENUMS(ThreeFingerDrag)
   Q_FLAGS(AcceptedGestures)
 
   Q_PROPERTY(bool enabled READ enabled WRITE set_enabled NOTIFY enabledChanged)
@@ -210,6 +223,12 @@ class QcMapGestureArea : public QQuickItem
   Q_PROPERTY(qreal maximum_zoom_level_change READ maximum_zoom_level_change WRITE set_maximum_zoom_level_change NOTIFY maximum_zoom_level_changeChanged)
   Q_PROPERTY(qreal flick_deceleration READ flick_deceleration WRITE set_flick_deceleration NOTIFY flick_decelerationChanged)
   Q_PROPERTY(bool prevent_stealing READ prevent_stealing WRITE set_prevent_stealing NOTIFY prevent_stealingChanged)
+  Q_PROPERTY(UpdateMode update_mode READ update_mode WRITE set_update_mode NOTIFY update_modeChanged)
+  Q_PROPERTY(int prediction_horizon READ prediction_horizon WRITE set_prediction_horizon NOTIFY prediction_horizonChanged)
+  Q_PROPERTY(VelocityEstimator velocity_estimator READ velocity_estimator WRITE set_velocity_estimator NOTIFY velocity_estimatorChanged)
+  Q_PROPERTY(ThreeFingerDrag three_finger_drag READ three_finger_drag WRITE set_three_finger_drag NOTIFY three_finger_dragChanged)
+  Q_PROPERTY(bool direct_manipulation READ direct_manipulation WRITE set_direct_manipulation NOTIFY direct_manipulationChanged)
+  Q_PROPERTY(QcGestureStatisticsObject * statistics READ statistics_object CONSTANT)
 
 public:
   QcMapGestureArea(QcMapItem * map);
@@ -226,6 +245,25 @@ public:
 
   Q_DECLARE_FLAGS(AcceptedGestures, GeoMapGesture)
 
+  enum UpdateMode {
+    ImmediateUpdate, // run the state machines on each input event
+    FrameUpdate      // coalesce move events and run the state machines once per frame
+  };
+
+  // same values as QcVelocityTracker::Estimator
+  enum VelocityEstimator {
+    TwoPointVelocity,
+    LeastSquaresVelocity,
+    ImpulseVelocity
+  };
+
+  // camera controls mapped to a three finger drag
+  enum ThreeFingerDrag {
+    NoThreeFingerDrag,   // three fingers behave like two
+    TiltDrag,            // vertical drag tilts
+    TiltAndBearingDrag   // vertical drag tilts, horizontal drag rotates
+  };
+
   AcceptedGestures accepted_gestures() const;
   void set_accepted_gestures(AcceptedGestures accepted_gestures);
 
@@ -270,6 +308,36 @@ public:
   bool prevent_stealing() const;
   void set_prevent_stealing(bool prevent);
 
+  UpdateMode update_mode() const;
+  void set_update_mode(UpdateMode mode);
+
+  int prediction_horizon() const;
+  void set_prediction_horizon(int horizon);
+
+  VelocityEstimator velocity_estimator() const;
+  void set_velocity_estimator(VelocityEstimator estimator);
+
+  ThreeFingerDrag three_finger_drag() const;
+  void set_three_finger_drag(ThreeFingerDrag mapping);
+
+  bool direct_manipulation() const;
+  void set_direct_manipulation(bool enabled);
+
+  void flush_pending_update();
+
+  QcGestureRecorder * recorder() const { return m_recorder; }
+  void set_recorder(QcGestureRecorder * recorder) { m_recorder = recorder; }
+
+  QcGestureTraceBuffer * trace_buffer() const { return m_trace_buffer; }
+  void set_trace_buffer(QcGestureTraceBuffer * trace_buffer) { m_trace_buffer = trace_buffer; }
+
+  const QcGestureStatistics & statistics() const { return m_statistics; }
+  QcGestureStatisticsObject * statistics_object() const { return m_statistics_object; }
+  Q_INVOKABLE void reset_statistics() { m_statistics.reset(); }
+
+protected:
+  void updatePolish() override;
+
 Q_SIGNALS:
   void pan_activeChanged();
   void pinch_activeChanged();
@@ -293,8 +361,14 @@ Q_SIGNALS:
   void tilt_updated(QcMapPinchEvent * pinch);
   void tilt_finished(QcMapPinchEvent * pinch);
   void prevent_stealingChanged();
+  void update_modeChanged();
+  void prediction_horizonChanged();
+  void velocity_estimatorChanged();
+  void three_finger_dragChanged();
+  void direct_manipulationChanged();
 
 private:
+  void request_update(bool coalescable);
   void update();
 
   // Create general data relating to the touch points
@@ -303,27 +377,40 @@ private:
   void update_one_touch_point();
   void start_two_touch_points();
   void update_two_touch_points();
+  void update_touch_geometry();
+
+  // The multi-touch recognizers, see s_recognizers
+  void run_recognizers();
 
   // All two fingers vertical parallel panning related code, which encompasses tilting
-  void tilt_state_machine();
   bool can_start_tilt();
+  bool can_start_three_finger_drag();
   void start_tilt();
   void update_tilt();
   void end_tilt();
 
   // All two fingers rotation related code, which encompasses rotation
-  void rotation_state_machine();
   bool can_start_rotation();
   void start_rotation();
   void update_rotation();
   void end_rotation();
+  void start_bearing_inertia();
 
   // All pinch related code, which encompasses zoom
-  void pinch_state_machine();
   bool can_start_pinch();
   void start_pinch();
   void update_pinch();
   void end_pinch();
+  void start_zoom_inertia();
+
+  // Pinch and rotation solved at once as a similarity transform, see direct_manipulation
+  bool transform_enabled() const;
+  bool separate_pinch_enabled() const;
+  bool separate_rotation_enabled() const;
+  bool can_start_transform();
+  void start_transform();
+  void update_transform();
+  void end_transform();
 
   // Pan related code (regardles of number of touch points),
   // includes the flick based panning after letting go
@@ -331,8 +418,10 @@ private:
   bool can_start_pan();
   void update_pan();
   bool try_start_flick();
-  void start_flick(int dx, int dy, int time_ms = 0);
+  bool start_flick(const QcVectorDouble & velocity); // [px/s]
   void stop_flick();
+  void prefetch_predicted_camera();
+  void cancel_prefetch();
 
   bool pinch_enabled() const;
   void set_pinch_enabled(bool enabled);
@@ -348,11 +437,15 @@ private:
   // private slots:
 private Q_SLOTS:
   void handle_flick_animation_stopped();
+  void handle_scroller_updated(QcKineticScroller::Channels channels);
+  void handle_scroller_finished(QcKineticScroller::Channels channels);
+  void handle_resample_timer_timeout();
 
 private:
   void stop_pan();
+  void set_mouse_point(const QMouseEvent * event, QEventPoint::State state);
   void clear_touch_data();
-  void update_flick_parameters(const QcVectorDouble & pos);
+  void add_input_sample(quint64 timestamp);
 
 private:
   QcMapItem * m_map;
@@ -391,6 +484,9 @@ private:
       qreal m_start;
       qreal m_previous;
       qreal maximum_change;
+      QcVelocityTracker m_velocity_tracker; // zoom rate, on x
+      QcVectorDouble m_anchor_point; // the zoom inertia is anchored at the last touch centroid
+      QcVectorDouble m_anchor; // coordinate under the anchor point, in normalised Mercator coordinates
     } m_zoom;
 
     struct Rotation
@@ -403,6 +499,7 @@ private:
       qreal m_start_bearing;
       qreal m_previous_touch_angle; // needed for detecting crossing +- 180 in a safer way
       qreal m_total_angle;
+      QcVelocityTracker m_velocity_tracker; // angular velocity, on x
     } m_rotation;
 
     struct Tilt
@@ -410,6 +507,7 @@ private:
       Tilt() {}
       QcVectorDouble m_start_touch_centroid;
       qreal m_start_tilt;
+      qreal m_start_bearing; // three finger drag
     } m_tilt;
 
     QcVectorDouble m_last_point1;
@@ -427,22 +525,27 @@ private:
       , m_pan_enabled(true)
       , m_max_velocity(2500)
       , m_deceleration(2500)
-      , m_animation(0)
+      , m_scroller(nullptr)
     {}
     bool m_flick_enabled;
     bool m_pan_enabled;
     qreal m_max_velocity;
     qreal m_deceleration;
-    QcGeoCoordinateAnimation * m_animation;
+    QcKineticScroller * m_scroller; // flick, zoom and rotation inertia
+    QcVectorDouble m_position; // flick position applied to the camera, in normalised Mercator coordinates
   } m_flick;
 
   // these are calculated regardless of gesture or number of touch points
   QVector2D m_flick_vector;
-  QElapsedTimer m_last_positionitionitionitionition_time;
-  QcVectorDouble m_last_positionitionitionition;
-  QList<QTouchEvent::TouchPoint> m_all_points;
-  QList<QTouchEvent::TouchPoint> m_touch_points;
-  QScopedPointer<QTouchEvent::TouchPoint> m_mouse_point;
+  QcVelocityTracker m_velocity_tracker; // velocity of the touch centroid
+  quint64 m_input_timestamp; // timestamp of the latest input event [ms]
+  int m_prefetch_id; // prefetch request of the inertia, 0 if none
+  QcGestureStatistics m_statistics;
+  QcGestureStatisticsObject * m_statistics_object;
+  QcTouchPoints m_all_points;
+  QcTouchPoints m_touch_points;
+  QcTouchPointsGeometry m_touch_geometry; // centroid, spread and angle of all the points
+  std::optional<QcTouchPoint> m_mouse_point; // overwritten in place
   QcVectorDouble m_scene_start_point1;
 
   // only set when two points in contact
@@ -458,6 +561,18 @@ private:
   bool m_prevent_stealing;
   bool m_pan_enabled;
 
+  UpdateMode m_update_mode;
+  bool m_update_pending;
+
+  ThreeFingerDrag m_three_finger_drag;
+  bool m_direct_manipulation;
+
+  QcTouchResampler m_resampler; // touch centroid used to pan
+  QTimer m_resample_timer; // the pan is realigned to the raw centroid when the finger pauses
+
+  QcGestureRecorder * m_recorder; // not owned, record the raw input if set
+  QcGestureTraceBuffer * m_trace_buffer; // not owned, trace the state machines if set
+
 private:
   // prototype state machine...
 
@@ -467,23 +582,16 @@ private:
     TouchPoints2
   } m_touch_point_state;
 
-  enum PinchState {
-    PinchInactive,
-    PinchInactiveTwoPoints,
-    PinchActive
-  } m_pinch_state;
-
-  enum RotationState {
-    RotationInactive,
-    RotationInactiveTwoPoints,
-    RotationActive
-  } m_rotation_state;
-
-  enum TiltState {
-    TiltInactive,
-    TiltInactiveTwoPoints,
-    TiltActive
-  } m_tilt_state;
+  // Multi-touch recognizers, in the order of priority
+  enum Recognizer {
+    TiltRecognizer = 0x1,
+    PinchRecognizer = 0x2,
+    RotationRecognizer = 0x4,
+    TransformRecognizer = 0x8
+  };
+  static constexpr int NumberOfRecognizers = 4;
+  static const QcGestureRecognizer<QcMapGestureArea> s_recognizers[NumberOfRecognizers];
+  QcGestureArbiter<QcMapGestureArea, NumberOfRecognizers> m_arbiter;
 
   enum FlickState {
     FlickInactive,
@@ -493,9 +601,6 @@ private:
 
   inline void set_touch_point_state(const TouchPointState state);
   inline void set_flick_state(const FlickState state);
-  inline void set_tilt_state(const TiltState state);
-  inline void set_rotation_state(const RotationState state);
-  inline void set_pinch_state(const PinchState state);
 };
 
 // QT_END_NAMESPACE
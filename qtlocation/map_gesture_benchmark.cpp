@@ -0,0 +1,224 @@
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+/* Headless benchmark of the map gesture area.
+ *
+ * Replays the synthetic gestures, and the gesture records given on the command line, into a
+ * gesture area hosted in an offscreen window and prints a report for each of them.
+ *
+ * Allocations are counted when the executable is compiled with QC_GESTURE_REPLAY_COUNT_ALLOCATIONS,
+ * the global operator new is replaced in this translation unit only, thus the library is not
+ * affected.
+ */
+
+/**************************************************************************************************/
+
+#include "map_gesture_area.h"
+#include "map_gesture_recorder.h"
+#include "map_gesture_replay.h"
+
+#include "declarative_map_item.h"
+
+#include <QCommandLineParser>
+#include <QGuiApplication>
+#include <QQuickWindow>
+#include <QTextStream>
+
+#include <memory>
+#include <vector>
+
+/**************************************************************************************************/
+
+#ifdef QC_GESTURE_REPLAY_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<qint64> qc_allocation_counter(0);
+
+void *
+operator new(std::size_t size)
+{
+  qc_allocation_counter.fetch_add(1, std::memory_order_relaxed);
+  if (void * ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+static qint64
+allocation_count()
+{
+  return qc_allocation_counter.load(std::memory_order_relaxed);
+}
+
+#endif
+
+/**************************************************************************************************/
+
+/* Count the allocations of the mouse move handler.
+ *
+ * The synthetic mouse point is overwritten in place, thus a mouse move must not allocate.  The
+ * moves are processed immediately, so that the count covers the whole update: the state
+ * machines and the pan of the map camera.  The drag is replayed once beforehand, so that lazy
+ * initialisations are not counted.
+ *
+ * Return the number of allocations per move, -1 if allocations are not counted.
+ */
+static double
+benchmark_mouse_move(QcMapGestureReplay & replay, QcMapGestureArea & gesture_area)
+{
+  if (QcMapGestureReplay::allocation_count() < 0)
+    return -1;
+
+  QcGestureReplayScript script =
+    QcGestureReplayScript::mouse_drag(QcVectorDouble(200, 500), QcVectorDouble(500, 0), 1000);
+  std::vector<std::unique_ptr<QInputEvent>> events;
+  events.reserve(script.count());
+  for (const auto & event : script.events())
+    events.emplace_back(replay.make_event(event));
+
+  QcMapGestureArea::UpdateMode update_mode = gesture_area.update_mode();
+  gesture_area.set_update_mode(QcMapGestureArea::ImmediateUpdate);
+
+  for (const auto & event : events)
+    replay.deliver(event.get());
+
+  qint64 number_of_allocations = 0;
+  int number_of_moves = 0;
+  for (const auto & event : events) {
+    if (event->type() == QEvent::MouseMove) {
+      qint64 start_allocation_count = QcMapGestureReplay::allocation_count();
+      replay.deliver(event.get());
+      number_of_allocations += QcMapGestureReplay::allocation_count() - start_allocation_count;
+      number_of_moves++;
+    } else
+      replay.deliver(event.get());
+  }
+
+  gesture_area.set_update_mode(update_mode);
+
+  return double(number_of_allocations) / number_of_moves;
+}
+
+/**************************************************************************************************/
+
+int
+main(int argc, char * argv[])
+{
+  // a benchmark must not need a display
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+  QGuiApplication application(argc, argv);
+  QCoreApplication::setApplicationName(QStringLiteral("map-gesture-benchmark"));
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QStringLiteral("Replay gestures into the map gesture area"));
+  parser.addHelpOption();
+  QCommandLineOption real_time_option(QStringLiteral("real-time"),
+                                      QStringLiteral("Replay at the pace of the timestamps"));
+  parser.addOption(real_time_option);
+  parser.addPositionalArgument(QStringLiteral("records"), QStringLiteral("Gesture records to replay"),
+                               QStringLiteral("[records...]"));
+  parser.process(application);
+
+#ifdef QC_GESTURE_REPLAY_COUNT_ALLOCATIONS
+  QcMapGestureReplay::set_allocation_counter(allocation_count);
+#endif
+
+  QQuickWindow window;
+  window.resize(1000, 1000);
+  QcMapItem map(window.contentItem());
+  map.setSize(QSizeF(window.width(), window.height()));
+  // the gesture area drives the camera of the map it is constructed with
+  QcMapGestureArea gesture_area(&map);
+  gesture_area.setSize(map.size());
+
+  QcMapGestureReplay replay(&map, &gesture_area);
+  replay.set_real_time(parser.isSet(real_time_option));
+
+  const QcVectorDouble center(500, 500);
+  QVector<QcGestureReplayScript> scripts;
+  scripts << QcGestureReplayScript::pinch(center, 200, 600, 1000)
+          << QcGestureReplayScript::rotate(center, 400, 90, 1000)
+          << QcGestureReplayScript::tilt(center, 300, 200, 1000)
+          << QcGestureReplayScript::fling(QcVectorDouble(200, 500), QcVectorDouble(1500, 0), 300)
+          << QcGestureReplayScript::mouse_drag(QcVectorDouble(200, 500), QcVectorDouble(500, 0), 1000)
+          << QcGestureReplayScript::press_and_hold(center, 1500)
+          << QcGestureReplayScript::double_click(center)
+          << QcGestureReplayScript::wheel(center, 20);
+
+  for (const QString & path : parser.positionalArguments()) {
+    QcGestureRecordFile record_file;
+    if (!record_file.open(path)) {
+      qWarning() << "Cannot read the gesture record" << path;
+      return 1;
+    }
+    QcGestureReplayScript script = record_file.to_script();
+    script.set_name(path);
+    scripts << script;
+  }
+
+  QTextStream out(stdout);
+  int number_of_camera_updates = 0;
+  for (const auto & script : scripts) {
+    QcGestureReplayReport report = replay.run(script);
+    number_of_camera_updates += report.m_number_of_camera_updates;
+    out << report.to_string() << Qt::endl;
+  }
+
+  // else the gesture area is not wired to the map and the figures are meaningless
+  if (!number_of_camera_updates) {
+    qWarning() << "The gestures didn't update the camera";
+    return 1;
+  }
+
+  double mouse_move_allocations = benchmark_mouse_move(replay, gesture_area);
+  if (mouse_move_allocations < 0)
+    out << "mouse move allocations: n/a" << Qt::endl;
+  else {
+    out << "mouse move allocations: " << mouse_move_allocations << " / move" << Qt::endl;
+    if (mouse_move_allocations > 0)
+      return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,243 @@
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+/**************************************************************************************************/
+
+#include "map_gesture_kinetic_scroller.h"
+
+#include <cmath>
+
+#include <QtMath>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+QcVectorDouble
+QcKineticScroller::wgs84_to_mercator(double longitude, double latitude)
+{
+  latitude = qBound(-maximum_latitude, latitude, maximum_latitude);
+  double x = longitude / 360. + .5;
+  double y = (1. - std::log(std::tan(qDegreesToRadians(latitude) * .5 + M_PI_4)) / M_PI) * .5;
+  return QcVectorDouble(x, qBound(0., y, 1.));
+}
+
+QcVectorDouble
+QcKineticScroller::mercator_to_wgs84(const QcVectorDouble & mercator)
+{
+  double longitude = (mercator.x() - .5) * 360.;
+  double latitude = qRadiansToDegrees(2. * std::atan(std::exp(M_PI * (1. - 2. * mercator.y()))) - M_PI_2);
+  return QcVectorDouble(longitude, latitude);
+}
+
+/**************************************************************************************************/
+
+QcKineticScroller::QcKineticScroller(QObject * parent)
+  : QAbstractAnimation(parent),
+    m_active_channels(NoChannel),
+    m_position(),
+    m_velocity(),
+    m_deceleration(0),
+    m_zoom_level(),
+    m_bearing(),
+    m_last_time(0)
+{}
+
+void
+QcKineticScroller::activate(Channel channel)
+{
+  m_active_channels |= channel;
+  if (is_running())
+    return; // retarget, the driver keeps ticking
+  m_last_time = 0;
+  start();
+}
+
+void
+QcKineticScroller::fling(const QcVectorDouble & position, const QcVectorDouble & velocity, double deceleration)
+{
+  m_position = position;
+  m_velocity = velocity;
+  m_deceleration = qAbs(deceleration);
+  activate(Position);
+}
+
+void
+QcKineticScroller::fling_zoom_level(double zoom_level, double rate, double minimum, double maximum)
+{
+  m_zoom_level.m_value = zoom_level;
+  m_zoom_level.m_rate = rate;
+  m_zoom_level.m_minimum = minimum;
+  m_zoom_level.m_maximum = maximum;
+  activate(ZoomLevel);
+}
+
+void
+QcKineticScroller::fling_bearing(double bearing, double rate)
+{
+  m_bearing.m_value = bearing;
+  m_bearing.m_rate = rate;
+  activate(Bearing);
+}
+
+void
+QcKineticScroller::stop_channels(Channels channels)
+{
+  m_active_channels &= ~channels;
+  if (!m_active_channels)
+    stop();
+}
+
+int
+QcKineticScroller::remaining_time() const
+{
+  if (!m_deceleration)
+    return 0;
+  return qRound(1000 * m_velocity.magnitude() / m_deceleration);
+}
+
+int
+QcKineticScroller::time_to_rest() const
+{
+  double time = is_active(Position) ? remaining_time() / 1000. : 0; // [s]
+  // the rate decays down to the minimum rate
+  if (is_active(ZoomLevel) && qAbs(m_zoom_level.m_rate) > minimum_zoom_rate)
+    time = qMax(time, decay_time * std::log(qAbs(m_zoom_level.m_rate) / minimum_zoom_rate));
+  if (is_active(Bearing) && qAbs(m_bearing.m_rate) > minimum_bearing_rate)
+    time = qMax(time, decay_time * std::log(qAbs(m_bearing.m_rate) / minimum_bearing_rate));
+  return qRound(1000 * time);
+}
+
+QcVectorDouble
+QcKineticScroller::predicted_position() const
+{
+  double speed = m_velocity.magnitude();
+  if (!is_active(Position) || !speed || !m_deceleration)
+    return m_position;
+
+  QcVectorDouble position = m_position + m_velocity * (speed / (2 * m_deceleration));
+  double x = position.x() - std::floor(position.x());
+  return QcVectorDouble(x, qBound(0., position.y(), 1.));
+}
+
+double
+QcKineticScroller::predicted_decay(const Decay & channel)
+{
+  // the rate decays until it is negligible, the remaining distance is also negligible
+  double value = channel.m_value + channel.m_rate * decay_time;
+  return qBound(channel.m_minimum, value, channel.m_maximum);
+}
+
+double
+QcKineticScroller::predicted_zoom_level() const
+{
+  return is_active(ZoomLevel) ? predicted_decay(m_zoom_level) : m_zoom_level.m_value;
+}
+
+double
+QcKineticScroller::predicted_bearing() const
+{
+  return is_active(Bearing) ? predicted_decay(m_bearing) : m_bearing.m_value;
+}
+
+bool
+QcKineticScroller::step_position(double dt)
+{
+  double speed = m_velocity.magnitude();
+  if (!speed || !m_deceleration)
+    return false;
+
+  // Constant deceleration along the velocity, integrated exactly up to the stop
+  bool last_step = false;
+  double stop_time = speed / m_deceleration;
+  if (dt >= stop_time) {
+    dt = stop_time;
+    last_step = true;
+  }
+  double new_speed = last_step ? 0 : speed - m_deceleration * dt;
+  QcVectorDouble direction = m_velocity / speed;
+  m_position = m_position + direction * ((speed + new_speed) * .5 * dt);
+  m_velocity = direction * new_speed;
+
+  // wrap around the antimeridian, stop at the poles
+  double x = m_position.x() - std::floor(m_position.x());
+  double y = m_position.y();
+  if (y <= 0 || y >= 1) {
+    y = qBound(0., y, 1.);
+    m_velocity = QcVectorDouble(m_velocity.x(), 0);
+    last_step = last_step || !m_velocity.x();
+  }
+  m_position = QcVectorDouble(x, y);
+
+  return !last_step;
+}
+
+bool
+QcKineticScroller::step_decay(Decay & channel, double dt, double minimum_rate)
+{
+  // Exponential decay of the rate, integrated exactly
+  double decay = std::exp(-dt / decay_time);
+  channel.m_value += channel.m_rate * decay_time * (1. - decay);
+  channel.m_rate *= decay;
+
+  if (channel.m_value <= channel.m_minimum || channel.m_value >= channel.m_maximum) {
+    channel.m_value = qBound(channel.m_minimum, channel.m_value, channel.m_maximum);
+    channel.m_rate = 0;
+  }
+
+  return qAbs(channel.m_rate) >= minimum_rate;
+}
+
+void
+QcKineticScroller::updateCurrentTime(int current_time)
+{
+  double dt = (current_time - m_last_time) / 1000.; // [s]
+  m_last_time = current_time;
+  if (dt <= 0)
+    return;
+
+  Channels updated_channels = m_active_channels;
+  Channels finished_channels = NoChannel;
+  if (is_active(Position) && !step_position(dt))
+    finished_channels |= Position;
+  if (is_active(ZoomLevel) && !step_decay(m_zoom_level, dt, minimum_zoom_rate))
+    finished_channels |= ZoomLevel;
+  if (is_active(Bearing) && !step_decay(m_bearing, dt, minimum_bearing_rate))
+    finished_channels |= Bearing;
+
+  emit updated(updated_channels);
+
+  if (finished_channels) {
+    stop_channels(finished_channels);
+    emit channels_finished(finished_channels);
+  }
+}
+
+// QT_END_NAMESPACE
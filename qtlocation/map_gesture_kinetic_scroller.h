@@ -0,0 +1,159 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_KINETIC_SCROLLER_H
+#define MAP_GESTURE_KINETIC_SCROLLER_H
+
+/**************************************************************************************************/
+
+#include "geometry/vector.h"
+
+#include <QAbstractAnimation>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+/* Kinetic scrolling of the map camera.
+ *
+ * The scroller continues a gesture after the fingers lift on three channels that run
+ * independently: the map center, the zoom level and the bearing.  They are stepped together
+ * at each tick of the animation driver, which is the one of the window in a Qt Quick scene,
+ * and the updated() signal is emitted once per frame with the channels that moved, so that the
+ * camera is updated at once.
+ *
+ * The center is integrated in normalised Web Mercator coordinates with a constant deceleration.
+ * The Mercator space is uniform for a given zoom level, thus a flick covers the same screen
+ * distance at any latitude.  The x coordinate wraps around the antimeridian and the y
+ * velocity is cancelled at the poles.
+ *
+ * The zoom level and the bearing rates decay exponentially with the time constant
+ * decay_time, the zoom level stops at the bounds of its interval.
+ *
+ * The animation has no duration, it stops by itself when all the channels are at rest.  A new
+ * fling while running retargets the channel without restarting the animation.
+ */
+class QcKineticScroller : public QAbstractAnimation
+{
+  Q_OBJECT
+
+public:
+  enum Channel {
+    NoChannel = 0x0,
+    Position = 0x1,
+    ZoomLevel = 0x2,
+    Bearing = 0x4,
+    AllChannels = Position | ZoomLevel | Bearing
+  };
+  Q_DECLARE_FLAGS(Channels, Channel)
+
+  static constexpr double maximum_latitude = 85.05113; // [deg]
+  static constexpr double decay_time = .3; // [s]
+  static constexpr double minimum_zoom_rate = .05; // [zoom level/s]
+  static constexpr double minimum_bearing_rate = 1.; // [deg/s]
+
+  // Normalised Web Mercator coordinates, x in [0, 1] from the antimeridian eastward and
+  // y in [0, 1] from the north pole southward, as QWebMercator
+  static QcVectorDouble wgs84_to_mercator(double longitude, double latitude);
+  static QcVectorDouble mercator_to_wgs84(const QcVectorDouble & mercator); // (longitude, latitude)
+
+public:
+  QcKineticScroller(QObject * parent = nullptr);
+
+  int duration() const override { return -1; }
+
+  Channels active_channels() const { return m_active_channels; }
+  bool is_active(Channel channel) const { return m_active_channels.testFlag(channel); }
+  bool is_running() const { return state() == QAbstractAnimation::Running; }
+
+  const QcVectorDouble & position() const { return m_position; }
+  const QcVectorDouble & velocity() const { return m_velocity; } // [1/s]
+  double zoom_level() const { return m_zoom_level.m_value; }
+  double bearing() const { return m_bearing.m_value; } // [deg]
+
+  // deceleration is a magnitude [1/s^2]
+  void fling(const QcVectorDouble & position, const QcVectorDouble & velocity, double deceleration);
+  // rate in [zoom level/s]
+  void fling_zoom_level(double zoom_level, double rate, double minimum, double maximum);
+  // rate in [deg/s]
+  void fling_bearing(double bearing, double rate);
+
+  void stop_channels(Channels channels);
+
+  // Time to stop the position channel [ms]
+  int remaining_time() const;
+  // Time to stop all the active channels [ms]
+  int time_to_rest() const;
+
+  // Values at rest, the current values for the channels which are inactive
+  QcVectorDouble predicted_position() const;
+  double predicted_zoom_level() const;
+  double predicted_bearing() const;
+
+signals:
+  void updated(QcKineticScroller::Channels channels);
+  void channels_finished(QcKineticScroller::Channels channels);
+
+protected:
+  void updateCurrentTime(int current_time) override;
+
+private:
+  struct Decay
+  {
+    double m_value = 0;
+    double m_rate = 0;
+    double m_minimum = -qInf();
+    double m_maximum = qInf();
+  };
+
+  void activate(Channel channel);
+  bool step_position(double dt);
+  static bool step_decay(Decay & channel, double dt, double minimum_rate);
+  static double predicted_decay(const Decay & channel);
+
+private:
+  Channels m_active_channels;
+  QcVectorDouble m_position;
+  QcVectorDouble m_velocity;
+  double m_deceleration;
+  Decay m_zoom_level;
+  Decay m_bearing;
+  int m_last_time; // [ms]
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(QcKineticScroller::Channels)
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_KINETIC_SCROLLER_H
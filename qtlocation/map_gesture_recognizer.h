@@ -0,0 +1,165 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_RECOGNIZER_H
+#define MAP_GESTURE_RECOGNIZER_H
+
+/**************************************************************************************************/
+
+#include "map_gesture_trace.h"
+
+#include <algorithm>
+
+#include <QtGlobal>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+/* Descriptor of a multi-touch gesture recognizer of a gesture area.
+ *
+ * A recognizer declares member functions of the area: a predicate which tells if it is enabled,
+ * a start predicate, and the start, update and end actions.  The blockers are the recognizers
+ * which prevent it to start while they are active.  The descriptors of an area are stored in a
+ * constant table, adding a gesture is adding an entry.
+ */
+template <class Area>
+struct QcGestureRecognizer
+{
+  typedef bool (Area::*Predicate)() const;
+  typedef bool (Area::*StartPredicate)();
+  typedef void (Area::*Action)();
+
+  quint32 m_flag; // bit of the recognizer in the masks
+  quint32 m_blockers; // mask of the recognizers that block it
+  QcGestureTraceRecord::Machine m_trace_machine;
+  Predicate m_enabled;
+  StartPredicate m_can_start;
+  Action m_start;
+  Action m_update;
+  Action m_end;
+  Action m_active_changed; // signal
+};
+
+/**************************************************************************************************/
+
+/* Run the recognizers of a gesture area once per update and resolve their conflicts.
+ *
+ * The transitions are run in the table order, thus a recognizer sees the ones started before it
+ * in the same pass, and the table order is the priority.  Then the active recognizers are
+ * updated, except those which just started, transitions and updates don't happen on the same
+ * frame.  A recognizer is started when at least two points are down, and once started it ends
+ * only when the fingers are released.
+ */
+template <class Area, int N>
+class QcGestureArbiter
+{
+public:
+  typedef QcGestureRecognizer<Area> Recognizer;
+
+  // same values than the former state machines, for the traces
+  enum State {
+    Inactive,
+    InactiveTwoPoints,
+    Active
+  };
+
+public:
+  QcGestureArbiter()
+    : m_active(0)
+  {
+    std::fill(m_states, m_states + N, Inactive);
+  }
+
+  quint32 active() const { return m_active; }
+  bool is_active(quint32 flags) const { return m_active & flags; }
+
+  // Return the mask of the recognizers which started or ended
+  quint32 run(Area * area, const Recognizer (&recognizers)[N], int number_of_points,
+              QcGestureTraceBuffer * trace_buffer) {
+    quint32 changed = 0;
+
+    // Transitions
+    for (int i = 0; i < N; i++) {
+      const Recognizer & recognizer = recognizers[i];
+      State state = m_states[i];
+      State next_state;
+      if (state == Active) {
+        if (number_of_points > 1)
+          continue;
+        next_state = Inactive;
+        m_active &= ~recognizer.m_flag;
+        (area->*recognizer.m_end)();
+      } else if (!(area->*recognizer.m_enabled)()) {
+        continue;
+      } else if (number_of_points <= 1) {
+        next_state = Inactive;
+      } else if (!(m_active & recognizer.m_blockers) && (area->*recognizer.m_can_start)()) {
+        next_state = Active;
+        m_active |= recognizer.m_flag;
+        (area->*recognizer.m_start)();
+      } else {
+        next_state = InactiveTwoPoints;
+      }
+      if (next_state == state)
+        continue;
+      if (trace_buffer)
+        trace_buffer->trace_transition(recognizer.m_trace_machine, state, next_state);
+      m_states[i] = next_state;
+      if (state == Active || next_state == Active)
+        changed |= recognizer.m_flag;
+    }
+
+    // Updates
+    for (int i = 0; i < N; i++) {
+      const Recognizer & recognizer = recognizers[i];
+      if (m_states[i] == Active && !(changed & recognizer.m_flag))
+        (area->*recognizer.m_update)();
+    }
+
+    for (int i = 0; i < N; i++)
+      if (changed & recognizers[i].m_flag)
+        (area->*recognizers[i].m_active_changed)();
+
+    return changed;
+  }
+
+private:
+  State m_states[N];
+  quint32 m_active;
+};
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_RECOGNIZER_H
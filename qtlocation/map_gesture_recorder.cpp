@@ -0,0 +1,293 @@
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#include "map_gesture_recorder.h"
+#include "qtcarto.h"
+
+#include <cstring>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+static bool
+is_valid_header(const QcGestureRecordHeader & header)
+{
+  return std::memcmp(header.magic, QcGestureRecordHeader::magic_value, sizeof(header.magic)) == 0
+    && header.version == QcGestureRecordHeader::current_version
+    && header.byte_order == QcGestureRecordHeader::byte_order_mark
+    && header.record_size == sizeof(QcGestureRecord);
+}
+
+/**************************************************************************************************/
+
+QcGestureRecorder::QcGestureRecorder()
+  : m_file(),
+    m_staging_count(0),
+    m_number_of_records(0)
+{}
+
+QcGestureRecorder::~QcGestureRecorder()
+{
+  close();
+}
+
+bool
+QcGestureRecorder::open(const QString & path)
+{
+  close();
+
+  m_file.setFileName(path);
+  if (!m_file.open(QIODevice::ReadWrite)) // Append mode doesn't permit to read the header
+    return false;
+
+  QcGestureRecordHeader header;
+  if (m_file.size() == 0) {
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, QcGestureRecordHeader::magic_value, sizeof(header.magic));
+    header.version = QcGestureRecordHeader::current_version;
+    header.byte_order = QcGestureRecordHeader::byte_order_mark;
+    header.record_size = sizeof(QcGestureRecord);
+    if (m_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header)) {
+      m_file.close();
+      return false;
+    }
+  } else {
+    if (m_file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || !is_valid_header(header)) {
+      qQCWarning() << "Incompatible gesture recording" << path;
+      m_file.close();
+      return false;
+    }
+    // drop a truncated record, e.g. after a crash
+    qint64 size = m_file.size() - qint64(sizeof(header));
+    m_file.resize(sizeof(header) + size - size % sizeof(QcGestureRecord));
+    m_file.seek(m_file.size());
+  }
+
+  return true;
+}
+
+void
+QcGestureRecorder::close()
+{
+  if (!m_file.isOpen())
+    return;
+  flush();
+  m_file.close();
+}
+
+bool
+QcGestureRecorder::flush()
+{
+  if (!m_staging_count)
+    return true;
+
+  qint64 size = m_staging_count * sizeof(QcGestureRecord);
+  bool succeed = m_file.write(reinterpret_cast<const char *>(m_staging), size) == size;
+  m_staging_count = 0;
+  m_file.flush();
+  return succeed;
+}
+
+QcGestureRecord *
+QcGestureRecorder::next_record()
+{
+  if (m_staging_count == staging_size)
+    flush();
+  QcGestureRecord * record = &m_staging[m_staging_count++];
+  std::memset(record, 0, sizeof(QcGestureRecord));
+  m_number_of_records++;
+  return record;
+}
+
+void
+QcGestureRecorder::record(const QTouchEvent * event)
+{
+  if (!m_file.isOpen())
+    return;
+
+  quint8 type;
+  switch (event->type()) {
+  case QEvent::TouchBegin: type = QcGestureReplayEvent::TouchBegin; break;
+  case QEvent::TouchEnd: type = QcGestureReplayEvent::TouchEnd; break;
+  default: type = QcGestureReplayEvent::TouchUpdate; // TouchCancel is not replayed
+  }
+
+  const auto & points = event->points();
+  int number_of_points = qMin(int(points.size()), 255);
+  for (int i = 0; i < number_of_points; i++) {
+    const QEventPoint & point = points[i];
+    QcGestureRecord * record = next_record();
+    record->timestamp = point.timestamp();
+    record->x = point.position().x();
+    record->y = point.position().y();
+    record->scene_x = point.scenePosition().x();
+    record->scene_y = point.scenePosition().y();
+    record->id = point.id();
+    record->modifiers = event->modifiers();
+    record->type = type;
+    record->state = quint8(point.state());
+    record->point_index = i;
+    record->number_of_points = number_of_points;
+  }
+}
+
+void
+QcGestureRecorder::record(const QMouseEvent * event)
+{
+  if (!m_file.isOpen())
+    return;
+
+  quint8 type;
+  switch (event->type()) {
+  case QEvent::MouseButtonPress: type = QcGestureReplayEvent::MousePress; break;
+  case QEvent::MouseButtonRelease: type = QcGestureReplayEvent::MouseRelease; break;
+  case QEvent::MouseButtonDblClick: type = QcGestureReplayEvent::MouseDoubleClick; break;
+  default: type = QcGestureReplayEvent::MouseMove;
+  }
+
+  QcGestureRecord * record = next_record();
+  record->timestamp = event->timestamp();
+  record->x = event->position().x();
+  record->y = event->position().y();
+  record->scene_x = event->scenePosition().x();
+  record->scene_y = event->scenePosition().y();
+  record->modifiers = event->modifiers();
+  record->type = type;
+  record->number_of_points = 1;
+}
+
+void
+QcGestureRecorder::record(const QWheelEvent * event)
+{
+  if (!m_file.isOpen())
+    return;
+
+  QcGestureRecord * record = next_record();
+  record->timestamp = event->timestamp();
+  record->x = event->position().x();
+  record->y = event->position().y();
+  record->scene_x = event->scenePosition().x();
+  record->scene_y = event->scenePosition().y();
+  record->angle_delta_x = event->angleDelta().x();
+  record->angle_delta_y = event->angleDelta().y();
+  record->modifiers = event->modifiers();
+  record->type = QcGestureReplayEvent::Wheel;
+  record->number_of_points = 1;
+}
+
+/**************************************************************************************************/
+
+QcGestureRecordFile::QcGestureRecordFile()
+  : m_file(),
+    m_records(nullptr),
+    m_number_of_records(0),
+    m_error_string()
+{}
+
+QcGestureRecordFile::~QcGestureRecordFile()
+{
+  close();
+}
+
+bool
+QcGestureRecordFile::open(const QString & path)
+{
+  close();
+
+  m_file.setFileName(path);
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    m_error_string = m_file.errorString();
+    return false;
+  }
+
+  QcGestureRecordHeader header;
+  if (m_file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+      || !is_valid_header(header)) {
+    m_error_string = QStringLiteral("Not a compatible gesture recording");
+    m_file.close();
+    return false;
+  }
+
+  m_number_of_records = (m_file.size() - qint64(sizeof(header))) / qint64(sizeof(QcGestureRecord));
+  if (!m_number_of_records)
+    return true; // empty recording, nothing to map
+
+  uchar * data = m_file.map(sizeof(header), m_number_of_records * sizeof(QcGestureRecord));
+  if (!data) {
+    m_error_string = m_file.errorString();
+    m_number_of_records = 0;
+    m_file.close();
+    return false;
+  }
+  m_records = reinterpret_cast<const QcGestureRecord *>(data);
+
+  return true;
+}
+
+void
+QcGestureRecordFile::close()
+{
+  if (m_records)
+    m_file.unmap(reinterpret_cast<uchar *>(const_cast<QcGestureRecord *>(m_records)));
+  m_records = nullptr;
+  m_number_of_records = 0;
+  if (m_file.isOpen())
+    m_file.close();
+}
+
+QcGestureReplayScript
+QcGestureRecordFile::to_script() const
+{
+  QcGestureReplayScript script(m_file.fileName());
+
+  QcGestureReplayEvent event;
+  for (const auto & record : *this) {
+    if (record.point_index == 0) {
+      if (!event.m_points.isEmpty())
+        script.append(event);
+      event.m_type = QcGestureReplayEvent::Type(record.type);
+      event.m_timestamp = record.timestamp;
+      event.m_points.clear();
+      event.m_angle_delta = QcVectorDouble(record.angle_delta_x, record.angle_delta_y);
+      event.m_modifiers = Qt::KeyboardModifiers(record.modifiers);
+    }
+    event.m_points.append({record.id, QEventPoint::State(record.state),
+                           QcVectorDouble(record.x, record.y),
+                           QcVectorDouble(record.scene_x, record.scene_y)});
+  }
+  if (!event.m_points.isEmpty())
+    script.append(event);
+
+  return script;
+}
+
+// QT_END_NAMESPACE
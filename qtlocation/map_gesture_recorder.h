@@ -0,0 +1,166 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_RECORDER_H
+#define MAP_GESTURE_RECORDER_H
+
+/**************************************************************************************************/
+
+#include "map_gesture_replay.h"
+
+#include <QFile>
+#include <QMouseEvent>
+#include <QString>
+#include <QTouchEvent>
+#include <QWheelEvent>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+/* Gesture recording file format
+ *
+ * A file starts with a QcGestureRecordHeader followed by fixed size QcGestureRecord, in the
+ * host byte order.  An input event with n points is stored as n consecutive records, the first
+ * one having point_index == 0.  Mouse and wheel events have a single point.
+ *
+ * The file is append-only: a recorder appends to an existing file with a compatible header,
+ * and a reader can map it in memory and index the records without parsing.
+ */
+
+struct QcGestureRecordHeader
+{
+  static constexpr char magic_value[8] = {'Q', 'C', 'G', 'E', 'S', 'T', 'R', 'E'};
+  static constexpr quint32 current_version = 1;
+  static constexpr quint32 byte_order_mark = 0x01020304;
+
+  char magic[8];
+  quint32 version;
+  quint32 byte_order;
+  quint32 record_size;
+  quint32 reserved;
+};
+
+struct QcGestureRecord
+{
+  quint64 timestamp; // [ms]
+  double x; // position relative to the item
+  double y;
+  double scene_x; // position relative to the window
+  double scene_y;
+  qint32 angle_delta_x; // wheel [1/8 degree]
+  qint32 angle_delta_y;
+  qint32 id; // touch point id
+  quint32 modifiers; // Qt::KeyboardModifiers
+  quint8 type; // QcGestureReplayEvent::Type
+  quint8 state; // QEventPoint::State
+  quint8 point_index;
+  quint8 number_of_points;
+  quint32 reserved;
+};
+
+static_assert(sizeof(QcGestureRecordHeader) == 24, "unexpected QcGestureRecordHeader size");
+static_assert(sizeof(QcGestureRecord) == 64, "unexpected QcGestureRecord size");
+
+/**************************************************************************************************/
+
+/* Append the raw input received by a gesture area to a recording file.
+ *
+ * Records are staged in a fixed buffer and written when it is full, on flush() and on close(),
+ * thus recording doesn't allocate nor hit the file system on each event.
+ */
+class QcGestureRecorder
+{
+public:
+  static constexpr int staging_size = 256; // records
+
+public:
+  QcGestureRecorder();
+  ~QcGestureRecorder();
+
+  bool open(const QString & path);
+  void close();
+  bool is_open() const { return m_file.isOpen(); }
+  QString error_string() const { return m_file.errorString(); }
+
+  void record(const QTouchEvent * event);
+  void record(const QMouseEvent * event);
+  void record(const QWheelEvent * event);
+
+  bool flush();
+
+  qint64 number_of_records() const { return m_number_of_records; }
+
+private:
+  QcGestureRecord * next_record();
+
+private:
+  QFile m_file;
+  QcGestureRecord m_staging[staging_size];
+  int m_staging_count;
+  qint64 m_number_of_records;
+};
+
+/**************************************************************************************************/
+
+/* Read a recording file mapped in memory.
+ */
+class QcGestureRecordFile
+{
+public:
+  QcGestureRecordFile();
+  ~QcGestureRecordFile();
+
+  bool open(const QString & path);
+  void close();
+  bool is_open() const { return m_records != nullptr; }
+  const QString & error_string() const { return m_error_string; }
+
+  qint64 count() const { return m_number_of_records; }
+  const QcGestureRecord & at(qint64 i) const { return m_records[i]; }
+  const QcGestureRecord * begin() const { return m_records; }
+  const QcGestureRecord * end() const { return m_records + m_number_of_records; }
+
+  QcGestureReplayScript to_script() const;
+
+private:
+  QFile m_file;
+  const QcGestureRecord * m_records;
+  qint64 m_number_of_records;
+  QString m_error_string;
+};
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_RECORDER_H
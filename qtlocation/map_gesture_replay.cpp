@@ -0,0 +1,502 @@
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#include "map_gesture_replay.h"
+#include "map_gesture_area.h"
+#include "qtcarto.h"
+
+#include "declarative_map_item.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMouseEvent>
+#include <QPointingDevice>
+#include <QTouchEvent>
+#include <QtMath>
+#include <QtGui/QWheelEvent>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+QcGestureReplayScript::QcGestureReplayScript(const QString & name)
+  : m_name(name),
+    m_events()
+{}
+
+quint64
+QcGestureReplayScript::duration() const
+{
+  if (m_events.isEmpty())
+    return 0;
+  return m_events.last().m_timestamp - m_events.first().m_timestamp;
+}
+
+void
+QcGestureReplayScript::append(const QcGestureReplayScript & script)
+{
+  if (script.isEmpty())
+    return;
+
+  // leave a frame between the two scripts
+  quint64 offset = m_events.isEmpty() ? 0 : m_events.last().m_timestamp + 16;
+  offset -= script.m_events.first().m_timestamp;
+  for (auto event : script.m_events) {
+    event.m_timestamp += offset;
+    m_events.append(event);
+  }
+}
+
+/// Generate a touch stream from a function returning the finger positions at time t in [0, 1]
+template <typename Function>
+static QcGestureReplayScript
+touch_stream(const QString & name, int number_of_fingers, int duration, int rate, Function positions)
+{
+  QcGestureReplayScript script(name);
+
+  int number_of_samples = qMax(duration * rate / 1000, 1);
+  QcVectorDouble finger_positions[2];
+
+  for (int i = 0; i <= number_of_samples; i++) {
+    double t = double(i) / number_of_samples;
+    positions(t, finger_positions);
+
+    QcGestureReplayEvent event;
+    event.m_timestamp = quint64(t * duration);
+    QEventPoint::State state;
+    if (i == 0) {
+      event.m_type = QcGestureReplayEvent::TouchBegin;
+      state = QEventPoint::State::Pressed;
+    } else if (i == number_of_samples) {
+      event.m_type = QcGestureReplayEvent::TouchEnd;
+      state = QEventPoint::State::Released;
+    } else {
+      event.m_type = QcGestureReplayEvent::TouchUpdate;
+      state = QEventPoint::State::Updated;
+    }
+    for (int j = 0; j < number_of_fingers; j++)
+      event.m_points.append({j, state, finger_positions[j]});
+
+    script.append(event);
+  }
+
+  return script;
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::pinch(const QcVectorDouble & center,
+                             double start_distance, double end_distance,
+                             int duration, int rate)
+{
+  return touch_stream(QStringLiteral("pinch"), 2, duration, rate,
+                      [&](double t, QcVectorDouble * points) {
+                        double half_distance = .5 * (start_distance + t * (end_distance - start_distance));
+                        points[0] = center - QcVectorDouble(half_distance, 0);
+                        points[1] = center + QcVectorDouble(half_distance, 0);
+                      });
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::rotate(const QcVectorDouble & center,
+                              double distance, double angle,
+                              int duration, int rate)
+{
+  return touch_stream(QStringLiteral("rotate"), 2, duration, rate,
+                      [&](double t, QcVectorDouble * points) {
+                        double theta = qDegreesToRadians(t * angle);
+                        QcVectorDouble offset(.5 * distance * cos(theta), .5 * distance * sin(theta));
+                        points[0] = center - offset;
+                        points[1] = center + offset;
+                      });
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::tilt(const QcVectorDouble & center,
+                            double distance, double translation,
+                            int duration, int rate)
+{
+  return touch_stream(QStringLiteral("tilt"), 2, duration, rate,
+                      [&](double t, QcVectorDouble * points) {
+                        QcVectorDouble origin = center + QcVectorDouble(0, t * translation);
+                        points[0] = origin - QcVectorDouble(.5 * distance, 0);
+                        points[1] = origin + QcVectorDouble(.5 * distance, 0);
+                      });
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::fling(const QcVectorDouble & start,
+                             const QcVectorDouble & velocity,
+                             int duration, int rate)
+{
+  double duration_s = duration / 1000.;
+  return touch_stream(QStringLiteral("fling"), 1, duration, rate,
+                      [&](double t, QcVectorDouble * points) {
+                        points[0] = start + velocity * (t * duration_s);
+                      });
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::mouse_drag(const QcVectorDouble & start,
+                                  const QcVectorDouble & velocity,
+                                  int duration, int rate)
+{
+  QcGestureReplayScript script(QStringLiteral("mouse_drag"));
+
+  int number_of_samples = qMax(duration * rate / 1000, 1);
+  double duration_s = duration / 1000.;
+
+  for (int i = 0; i <= number_of_samples; i++) {
+    double t = double(i) / number_of_samples;
+    QcGestureReplayEvent event;
+    if (i == 0)
+      event.m_type = QcGestureReplayEvent::MousePress;
+    else if (i == number_of_samples)
+      event.m_type = QcGestureReplayEvent::MouseRelease;
+    else
+      event.m_type = QcGestureReplayEvent::MouseMove;
+    event.m_timestamp = quint64(t * duration);
+    event.m_points.append({0, QEventPoint::State::Unknown, start + velocity * (t * duration_s)});
+    script.append(event);
+  }
+
+  return script;
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::press_and_hold(const QcVectorDouble & position, int duration, int rate)
+{
+  // sub-pixel jitter, below any gesture threshold
+  return touch_stream(QStringLiteral("press_and_hold"), 1, duration, rate,
+                      [&](double t, QcVectorDouble * points) {
+                        points[0] = position + QcVectorDouble(.5 * sin(t * 50), .5 * cos(t * 50));
+                      });
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::double_click(const QcVectorDouble & position, int interval)
+{
+  QcGestureReplayScript script(QStringLiteral("double_click"));
+
+  // Same sequence as QGuiApplication: press, release, double click, release
+  const QcGestureReplayEvent::Type types[] = {
+    QcGestureReplayEvent::MousePress,
+    QcGestureReplayEvent::MouseRelease,
+    QcGestureReplayEvent::MouseDoubleClick,
+    QcGestureReplayEvent::MouseRelease,
+  };
+  const quint64 timestamps[] = {0, 10, quint64(interval), quint64(interval) + 10};
+  for (int i = 0; i < 4; i++) {
+    QcGestureReplayEvent event;
+    event.m_type = types[i];
+    event.m_timestamp = timestamps[i];
+    event.m_points.append({0, QEventPoint::State::Unknown, position});
+    script.append(event);
+  }
+
+  return script;
+}
+
+QcGestureReplayScript
+QcGestureReplayScript::wheel(const QcVectorDouble & position, int number_of_steps,
+                             double angle_delta, int interval)
+{
+  QcGestureReplayScript script(QStringLiteral("wheel"));
+
+  for (int i = 0; i < number_of_steps; i++) {
+    QcGestureReplayEvent event;
+    event.m_type = QcGestureReplayEvent::Wheel;
+    event.m_timestamp = i * interval;
+    event.m_points.append({0, QEventPoint::State::Unknown, position});
+    event.m_angle_delta = QcVectorDouble(0, angle_delta);
+    script.append(event);
+  }
+
+  return script;
+}
+
+/**************************************************************************************************/
+
+/// Nearest-rank percentile of sorted samples
+static qint64
+percentile(const QVector<qint64> & sorted_samples, double p)
+{
+  if (sorted_samples.isEmpty())
+    return 0;
+  int rank = qCeil(p * sorted_samples.size()) - 1;
+  return sorted_samples[qBound(0, rank, int(sorted_samples.size()) - 1)];
+}
+
+QString
+QcGestureReplayReport::to_string() const
+{
+  QString allocations = m_number_of_allocations < 0 ?
+    QStringLiteral("n/a") :
+    QStringLiteral("%1 (%2 / event)").arg(m_number_of_allocations).arg(m_allocations_per_event, 0, 'f', 2);
+
+  return QStringLiteral("%1: %2 events, %3 frames\n"
+                        "  latency [us]: p50 %4 p95 %5 p99 %6 max %7\n"
+                        "  frame latency [us]: p50 %8 max %9\n"
+                        "  allocations: %10\n"
+                        "  camera updates: %11 (%12 / frame, max %13)\n"
+                        "  flicks: %14")
+    .arg(m_name).arg(m_number_of_events).arg(m_number_of_frames)
+    .arg(m_latency_p50 / 1000.).arg(m_latency_p95 / 1000.).arg(m_latency_p99 / 1000.).arg(m_latency_max / 1000.)
+    .arg(m_frame_latency_p50 / 1000.).arg(m_frame_latency_max / 1000.)
+    .arg(allocations)
+    .arg(m_number_of_camera_updates).arg(m_camera_updates_per_frame, 0, 'f', 2).arg(m_max_camera_updates_per_frame)
+    .arg(m_number_of_flicks);
+}
+
+/**************************************************************************************************/
+
+QcMapGestureReplay::QcMapGestureReplay(QcMapItem * map, QcMapGestureArea * gesture_area)
+  : m_map(map),
+    m_gesture_area(gesture_area),
+    m_touch_device(new QPointingDevice(QStringLiteral("gesture replay"), 0x7C00,
+                                       QInputDevice::DeviceType::TouchScreen,
+                                       QPointingDevice::PointerType::Finger,
+                                       QInputDevice::Capability::Position,
+                                       QC_MAXIMUM_NUMBER_OF_TOUCH_POINTS, 0)),
+    m_real_time(false),
+    m_frame_interval(16)
+{}
+
+QcMapGestureReplay::~QcMapGestureReplay()
+{
+  delete m_touch_device;
+}
+
+static QcMapGestureReplay::AllocationCounter qc_allocation_counter = nullptr;
+
+void
+QcMapGestureReplay::set_allocation_counter(AllocationCounter counter)
+{
+  qc_allocation_counter = counter;
+}
+
+qint64
+QcMapGestureReplay::allocation_count()
+{
+  return qc_allocation_counter ? qc_allocation_counter() : -1;
+}
+
+QInputEvent *
+QcMapGestureReplay::make_event(const QcGestureReplayEvent & event) const
+{
+  // Only the scene positions are read by the gesture area
+  auto scene_position = [this](const QcGestureReplayPoint & point) {
+    if (point.m_scene_position)
+      return point.m_scene_position->to_pointf();
+    return m_map->mapToScene(point.m_position.to_pointf());
+  };
+
+  if (event.is_touch()) {
+    QList<QEventPoint> points;
+    points.reserve(event.m_points.size());
+    for (const auto & point : event.m_points) {
+      QPointF position = scene_position(point);
+      points.append(QEventPoint(point.m_id, point.m_state, position, position));
+    }
+    QEvent::Type type;
+    switch (event.m_type) {
+    case QcGestureReplayEvent::TouchBegin: type = QEvent::TouchBegin; break;
+    case QcGestureReplayEvent::TouchEnd: type = QEvent::TouchEnd; break;
+    default: type = QEvent::TouchUpdate;
+    }
+    QTouchEvent * touch_event = new QTouchEvent(type, m_touch_device, event.m_modifiers, points);
+    touch_event->setTimestamp(event.m_timestamp);
+    return touch_event;
+  }
+
+  QPointF position = event.m_points.first().m_position.to_pointf();
+  QPointF position_in_scene = scene_position(event.m_points.first());
+
+  if (event.m_type == QcGestureReplayEvent::Wheel) {
+    QWheelEvent * wheel_event = new QWheelEvent(position, position_in_scene, QPoint(),
+                                                event.m_angle_delta.to_pointf().toPoint(),
+                                                Qt::NoButton, event.m_modifiers, Qt::NoScrollPhase, false);
+    wheel_event->setTimestamp(event.m_timestamp);
+    return wheel_event;
+  }
+
+  QEvent::Type type;
+  Qt::MouseButtons buttons = Qt::LeftButton;
+  switch (event.m_type) {
+  case QcGestureReplayEvent::MousePress: type = QEvent::MouseButtonPress; break;
+  case QcGestureReplayEvent::MouseDoubleClick: type = QEvent::MouseButtonDblClick; break;
+  case QcGestureReplayEvent::MouseRelease: type = QEvent::MouseButtonRelease; buttons = Qt::NoButton; break;
+  default: type = QEvent::MouseMove;
+  }
+  Qt::MouseButton button = type == QEvent::MouseMove ? Qt::NoButton : Qt::LeftButton;
+  QMouseEvent * mouse_event = new QMouseEvent(type, position, position_in_scene, position_in_scene,
+                                              button, buttons, event.m_modifiers);
+  mouse_event->setTimestamp(event.m_timestamp);
+  return mouse_event;
+}
+
+void
+QcMapGestureReplay::deliver(QInputEvent * event)
+{
+  switch (event->type()) {
+  case QEvent::TouchBegin:
+  case QEvent::TouchUpdate:
+  case QEvent::TouchEnd:
+    m_gesture_area->handle_touch_event(static_cast<QTouchEvent *>(event));
+    break;
+  case QEvent::Wheel:
+    m_gesture_area->handle_wheel_event(static_cast<QWheelEvent *>(event));
+    break;
+  case QEvent::MouseButtonPress:
+  case QEvent::MouseButtonDblClick:
+    m_gesture_area->handle_mouse_press_event(static_cast<QMouseEvent *>(event));
+    break;
+  case QEvent::MouseButtonRelease:
+    m_gesture_area->handle_mouse_release_event(static_cast<QMouseEvent *>(event));
+    break;
+  default:
+    m_gesture_area->handle_mouse_move_event(static_cast<QMouseEvent *>(event));
+  }
+}
+
+/// Flush the input coalesced during the frame and return the time spent [ns]
+qint64
+QcMapGestureReplay::flush_frame(qint64 & number_of_allocations)
+{
+  qint64 start_allocation_count = allocation_count();
+  QElapsedTimer timer;
+  timer.start();
+  m_gesture_area->flush_pending_update();
+  qint64 elapsed = timer.nsecsElapsed();
+  number_of_allocations += allocation_count() - start_allocation_count;
+  return elapsed;
+}
+
+QcGestureReplayReport
+QcMapGestureReplay::run(const QcGestureReplayScript & script)
+{
+  QcGestureReplayReport report;
+  report.m_name = script.name();
+  report.m_number_of_events = script.count();
+  if (script.isEmpty())
+    return report;
+
+  // Build the events upfront, they must not be timed or counted
+  std::vector<std::unique_ptr<QInputEvent>> input_events;
+  input_events.reserve(script.count());
+  for (const auto & event : script.events())
+    input_events.emplace_back(make_event(event));
+
+  // Count the camera updates per frame, as counted by the gesture area, a frame has at least
+  // one event
+  QVector<int> camera_updates_per_frame;
+  camera_updates_per_frame.reserve(script.count() + 1);
+  quint64 camera_updates = m_gesture_area->statistics().m_camera_updates;
+  auto close_frame = [&]() {
+    quint64 count = m_gesture_area->statistics().m_camera_updates;
+    camera_updates_per_frame.append(int(count - camera_updates));
+    camera_updates = count;
+  };
+  QMetaObject::Connection flick_connection =
+    QObject::connect(m_gesture_area, &QcMapGestureArea::flick_started,
+                     [&report]() { report.m_number_of_flicks++; });
+
+  QVector<qint64> latencies;
+  latencies.reserve(script.count());
+  QVector<qint64> frame_latencies;
+  frame_latencies.reserve(script.count() + 1);
+
+  const quint64 start_timestamp = script.events().first().m_timestamp;
+  quint64 frame_end = start_timestamp + m_frame_interval;
+
+  QElapsedTimer clock;
+  clock.start();
+  QElapsedTimer timer;
+  qint64 number_of_allocations = 0;
+
+  for (int i = 0; i < script.count(); i++) {
+    const QcGestureReplayEvent & event = script.events()[i];
+
+    // close the frames elapsed before this event
+    if (event.m_timestamp >= frame_end) {
+      frame_latencies.append(flush_frame(number_of_allocations));
+      close_frame();
+      while (event.m_timestamp >= frame_end)
+        frame_end += m_frame_interval;
+    }
+
+    if (m_real_time) {
+      qint64 due_time = event.m_timestamp - start_timestamp;
+      while (clock.elapsed() < due_time)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, due_time - clock.elapsed());
+    }
+
+    qint64 start_allocation_count = allocation_count();
+    timer.start();
+    deliver(input_events[i].get());
+    qint64 elapsed = timer.nsecsElapsed();
+    number_of_allocations += allocation_count() - start_allocation_count;
+    latencies.append(elapsed);
+  }
+  frame_latencies.append(flush_frame(number_of_allocations));
+  close_frame();
+
+  QObject::disconnect(flick_connection);
+
+  std::sort(latencies.begin(), latencies.end());
+  report.m_latency_p50 = percentile(latencies, .50);
+  report.m_latency_p95 = percentile(latencies, .95);
+  report.m_latency_p99 = percentile(latencies, .99);
+  report.m_latency_max = latencies.last();
+
+  std::sort(frame_latencies.begin(), frame_latencies.end());
+  report.m_number_of_frames = frame_latencies.size();
+  report.m_frame_latency_p50 = percentile(frame_latencies, .50);
+  report.m_frame_latency_max = frame_latencies.last();
+
+  if (qc_allocation_counter) {
+    report.m_number_of_allocations = number_of_allocations;
+    report.m_allocations_per_event = double(report.m_number_of_allocations) / report.m_number_of_events;
+  }
+
+  for (int count : camera_updates_per_frame) {
+    report.m_number_of_camera_updates += count;
+    report.m_max_camera_updates_per_frame = qMax(report.m_max_camera_updates_per_frame, count);
+  }
+  report.m_camera_updates_per_frame = double(report.m_number_of_camera_updates) / report.m_number_of_frames;
+
+  return report;
+}
+
+// QT_END_NAMESPACE
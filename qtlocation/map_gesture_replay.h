@@ -0,0 +1,242 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_REPLAY_H
+#define MAP_GESTURE_REPLAY_H
+
+/**************************************************************************************************/
+
+#include "geometry/vector.h"
+
+#include <optional>
+
+#include <QEventPoint>
+#include <QString>
+#include <QVector>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+class QcMapGestureArea;
+class QcMapItem;
+class QInputEvent;
+class QPointingDevice;
+
+/**************************************************************************************************/
+
+/* A point of a touch event, the position is relative to the map item.
+ *
+ * The scene position is set for recorded events so that they are replayed bit-for-bit,
+ * else it is computed from the position.
+ */
+struct QcGestureReplayPoint
+{
+  int m_id;
+  QEventPoint::State m_state;
+  QcVectorDouble m_position;
+  std::optional<QcVectorDouble> m_scene_position = std::nullopt;
+};
+
+/**************************************************************************************************/
+
+/* An input event of a gesture script.
+ */
+struct QcGestureReplayEvent
+{
+  enum Type {
+    TouchBegin,
+    TouchUpdate,
+    TouchEnd,
+    MousePress,
+    MouseMove,
+    MouseRelease,
+    MouseDoubleClick,
+    Wheel
+  };
+
+  Type m_type;
+  quint64 m_timestamp; // [ms]
+  QVector<QcGestureReplayPoint> m_points; // touch points, or a single point for mouse and wheel events
+  QcVectorDouble m_angle_delta; // wheel only [1/8 degree]
+  Qt::KeyboardModifiers m_modifiers = Qt::NoModifier;
+
+  bool is_touch() const { return m_type <= TouchEnd; }
+};
+
+/**************************************************************************************************/
+
+/* A stream of input events to be replayed, either recorded or synthetic.
+ *
+ * The factories generate the classical map gestures at a given sampling rate,
+ * positions are relative to the map item.
+ */
+class QcGestureReplayScript
+{
+public:
+  QcGestureReplayScript(const QString & name = QString());
+
+  const QString & name() const { return m_name; }
+  void set_name(const QString & name) { m_name = name; }
+
+  const QVector<QcGestureReplayEvent> & events() const { return m_events; }
+  int count() const { return m_events.size(); }
+  bool isEmpty() const { return m_events.isEmpty(); }
+  quint64 duration() const; // [ms]
+
+  void append(const QcGestureReplayEvent & event) { m_events.append(event); }
+  void append(const QcGestureReplayScript & script); // shifted after the last event
+  void clear() { m_events.clear(); }
+
+  // Two fingers moving apart (or closer) symmetrically around the center
+  static QcGestureReplayScript pinch(const QcVectorDouble & center,
+                                     double start_distance, double end_distance,
+                                     int duration, int rate = 120);
+  // Two fingers rotating around the center
+  static QcGestureReplayScript rotate(const QcVectorDouble & center,
+                                      double distance, double angle, // [deg]
+                                      int duration, int rate = 120);
+  // Two horizontal fingers moving vertically in parallel
+  static QcGestureReplayScript tilt(const QcVectorDouble & center,
+                                    double distance, double translation,
+                                    int duration, int rate = 120);
+  // One finger moving at a constant velocity then released
+  static QcGestureReplayScript fling(const QcVectorDouble & start,
+                                     const QcVectorDouble & velocity, // [px/s]
+                                     int duration, int rate = 120);
+  // Mouse pressed, moved at a constant velocity then released
+  static QcGestureReplayScript mouse_drag(const QcVectorDouble & start,
+                                          const QcVectorDouble & velocity, // [px/s]
+                                          int duration, int rate = 120);
+  // One finger pressed with a small jitter
+  static QcGestureReplayScript press_and_hold(const QcVectorDouble & position,
+                                              int duration, int rate = 120);
+  // Mouse double click
+  static QcGestureReplayScript double_click(const QcVectorDouble & position, int interval = 100);
+  // Mouse wheel steps
+  static QcGestureReplayScript wheel(const QcVectorDouble & position, int number_of_steps,
+                                     double angle_delta = 120, int interval = 16);
+
+private:
+  QString m_name;
+  QVector<QcGestureReplayEvent> m_events;
+};
+
+/**************************************************************************************************/
+
+/* Measurements of a replay.
+ *
+ * Latencies are the time spent in the gesture area handlers, frame latencies are the
+ * time spent to flush the coalesced input at the end of each frame.
+ */
+struct QcGestureReplayReport
+{
+  QString m_name;
+  int m_number_of_events = 0;
+  int m_number_of_frames = 0;
+
+  // [ns]
+  qint64 m_latency_p50 = 0;
+  qint64 m_latency_p95 = 0;
+  qint64 m_latency_p99 = 0;
+  qint64 m_latency_max = 0;
+  qint64 m_frame_latency_p50 = 0;
+  qint64 m_frame_latency_max = 0;
+
+  qint64 m_number_of_allocations = -1; // -1 if allocations are not counted
+  double m_allocations_per_event = 0;
+
+  int m_number_of_camera_updates = 0;
+  double m_camera_updates_per_frame = 0;
+  int m_max_camera_updates_per_frame = 0;
+
+  int m_number_of_flicks = 0; // to compare the velocity estimators
+
+  QString to_string() const;
+};
+
+/**************************************************************************************************/
+
+/* Feed a gesture script into a gesture area and measure it.
+ *
+ * The map item should be hosted in a window, e.g. a QQuickView using the offscreen platform
+ * plugin, so that the map is initialised and scene positions are defined.
+ *
+ * Events are built before the replay and delivered directly to the handlers of the gesture area,
+ * only the handler calls are timed and counted.  By default the script is replayed as fast as
+ * possible, the timestamps are only used to group the events into frames.  In real time mode,
+ * the replay waits for the timestamp of each event while processing the Qt events, so that
+ * timers and animations (e.g. the flick) run as in an interactive session.
+ *
+ * Allocations are only counted when an allocation counter is installed, the benchmark executable
+ * installs one when it is compiled with QC_GESTURE_REPLAY_COUNT_ALLOCATIONS, since it must
+ * replace the global operator new.
+ */
+class QcMapGestureReplay
+{
+public:
+  typedef qint64 (*AllocationCounter)();
+
+public:
+  QcMapGestureReplay(QcMapItem * map, QcMapGestureArea * gesture_area);
+  ~QcMapGestureReplay();
+
+  bool real_time() const { return m_real_time; }
+  void set_real_time(bool real_time) { m_real_time = real_time; }
+
+  int frame_interval() const { return m_frame_interval; } // [ms]
+  void set_frame_interval(int interval) { m_frame_interval = interval; }
+
+  QcGestureReplayReport run(const QcGestureReplayScript & script);
+
+  static void set_allocation_counter(AllocationCounter counter);
+  static qint64 allocation_count(); // -1 if allocations are not counted
+
+  // Build the Qt event of a script event, positions are mapped to the scene
+  QInputEvent * make_event(const QcGestureReplayEvent & event) const;
+  // Call the handler of the gesture area
+  void deliver(QInputEvent * event);
+
+private:
+  qint64 flush_frame(qint64 & number_of_allocations);
+
+private:
+  QcMapItem * m_map;
+  QcMapGestureArea * m_gesture_area;
+  QPointingDevice * m_touch_device;
+  bool m_real_time;
+  int m_frame_interval;
+};
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_REPLAY_H
@@ -0,0 +1,154 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_RESAMPLER_H
+#define MAP_GESTURE_RESAMPLER_H
+
+/**************************************************************************************************/
+
+#include "geometry/vector.h"
+
+#include <algorithm>
+
+#include <QElapsedTimer>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+/* Predict a touch position at the frame time from the last two input samples.
+ *
+ * The position is linearly extrapolated from the last two samples to the time of the latest
+ * sample, plus the time elapsed since it was received, plus the prediction horizon.  This
+ * compensates the input period and the delay up to the frame, like the touch resampling of
+ * Android.
+ *
+ * The jitter guard disables the prediction when the two samples are too close in time (the
+ * velocity is noise) or too far apart (the finger paused), and the time elapsed since the
+ * receipt is accounted up to half the sampling interval, so that a late frame doesn't
+ * overshoot.
+ *
+ * The pause threshold is twice the median of the last sampling intervals, and at least 20 ms,
+ * thus it follows the input rate of the device, and the jitter of a 60 Hz input doesn't toggle
+ * the prediction.
+ */
+class QcTouchResampler
+{
+public:
+  static constexpr int minimum_sample_interval = 2; // [ms]
+  static constexpr int minimum_pause_interval = 20; // [ms]
+  static constexpr int maximum_pause_interval = 1000; // [ms]
+  static constexpr int maximum_horizon = 50; // [ms]
+  static constexpr int number_of_intervals = 8; // for the median
+
+public:
+  QcTouchResampler()
+    : m_horizon(0),
+      m_count(0),
+      m_number_of_intervals(0),
+      m_next_interval(0),
+      m_pause_interval(minimum_pause_interval)
+  {}
+
+  int horizon() const { return m_horizon; } // [ms], 0 disables the resampling
+  void set_horizon(int horizon) { m_horizon = qBound(0, horizon, maximum_horizon); }
+  bool is_enabled() const { return m_horizon > 0; }
+
+  // the intervals are kept, the input rate doesn't change from a gesture to the next
+  void reset() { m_count = 0; }
+
+  // [ms] samples further apart mean that the finger paused
+  int pause_interval() const { return m_pause_interval; }
+
+  void add_sample(quint64 timestamp, const QcVectorDouble & position) {
+    if (m_count && timestamp <= m_samples[1].m_timestamp) {
+      // same input frame, or out of order timestamp: keep the latest position
+      m_samples[1].m_position = position;
+    } else {
+      if (m_count)
+        add_interval(timestamp - m_samples[1].m_timestamp);
+      m_samples[0] = m_samples[1];
+      m_samples[1] = {timestamp, position};
+      m_count = qMin(m_count + 1, 2);
+    }
+    m_receipt_time.start();
+  }
+
+  QcVectorDouble resample() const {
+    const Sample & latest = m_samples[1];
+    if (m_count < 2 || !m_horizon)
+      return latest.m_position;
+
+    const Sample & previous = m_samples[0];
+    qint64 interval = latest.m_timestamp - previous.m_timestamp;
+    if (interval < minimum_sample_interval || interval > m_pause_interval)
+      return latest.m_position;
+
+    qint64 prediction = qMin<qint64>(m_receipt_time.elapsed() + m_horizon, m_horizon + interval / 2);
+    double alpha = double(interval + prediction) / interval;
+    return previous.m_position + (latest.m_position - previous.m_position) * alpha;
+  }
+
+private:
+  void add_interval(qint64 interval) {
+    m_intervals[m_next_interval] = interval;
+    m_next_interval = (m_next_interval + 1) % number_of_intervals;
+    m_number_of_intervals = qMin(m_number_of_intervals + 1, number_of_intervals);
+
+    qint64 intervals[number_of_intervals];
+    std::copy(m_intervals, m_intervals + m_number_of_intervals, intervals);
+    qint64 * median = intervals + m_number_of_intervals / 2;
+    std::nth_element(intervals, median, intervals + m_number_of_intervals);
+    m_pause_interval = int(qBound<qint64>(minimum_pause_interval, 2 * *median, maximum_pause_interval));
+  }
+
+private:
+  struct Sample {
+    quint64 m_timestamp; // [ms]
+    QcVectorDouble m_position;
+  };
+
+  int m_horizon;
+  int m_count;
+  Sample m_samples[2];
+  QElapsedTimer m_receipt_time;
+  qint64 m_intervals[number_of_intervals]; // last sampling intervals [ms], a ring buffer
+  int m_number_of_intervals;
+  int m_next_interval;
+  int m_pause_interval; // [ms]
+};
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_RESAMPLER_H
@@ -0,0 +1,145 @@
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#include "map_gesture_statistics.h"
+
+#include "declarative_map_item.h"
+
+#include <QTextStream>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+quint64
+QcGestureStatistics::number_of_events() const
+{
+  quint64 number_of_events = 0;
+  for (quint64 count : m_events)
+    number_of_events += count;
+  return number_of_events;
+}
+
+double
+QcGestureStatistics::average_update_time() const
+{
+  return m_state_machine_runs ? double(m_update_time_total) / m_state_machine_runs : 0;
+}
+
+double
+QcGestureStatistics::average_input_latency() const
+{
+  return m_input_latency_samples ? double(m_input_latency_total) / m_input_latency_samples : 0;
+}
+
+void
+QcGestureStatistics::add_update_time(qint64 time)
+{
+  m_state_machine_runs++;
+  m_update_time_total += time;
+  m_update_time_max = qMax(m_update_time_max, time);
+}
+
+void
+QcGestureStatistics::add_input_latency(quint64 input_timestamp)
+{
+  if (!input_timestamp)
+    return;
+  qint64 latency = QElapsedTimer::msecsSinceReference() - qint64(input_timestamp);
+  if (!QcMapItem::isValidInputLatency(latency))
+    return; // the event timestamp is not from the monotonic clock
+  m_input_latency_samples++;
+  m_input_latency_total += latency;
+  m_input_latency_max = qMax(m_input_latency_max, latency);
+}
+
+QString
+QcGestureStatistics::to_string() const
+{
+  QString string;
+  QTextStream stream(&string);
+  stream << "events: " << number_of_events()
+         << " (touch " << m_events[TouchEvent]
+         << ", mouse press " << m_events[MousePressEvent]
+         << ", mouse move " << m_events[MouseMoveEvent]
+         << ", mouse release " << m_events[MouseReleaseEvent]
+         << ", wheel " << m_events[WheelEvent]
+         << ", ungrab " << m_events[UngrabEvent] << ")\n"
+         << "state machine runs: " << m_state_machine_runs << '\n'
+         << "camera updates: " << m_camera_updates << '\n'
+         << "flicks: " << m_flicks_started << " started, " << m_flicks_aborted << " aborted\n"
+         << "update time: average " << average_update_time() / 1000. << " us, max "
+         << m_update_time_max / 1000. << " us\n"
+         << "input latency: average " << average_input_latency() << " ms, max "
+         << m_input_latency_max << " ms (" << m_input_latency_samples << " samples)\n";
+  return string;
+}
+
+/**************************************************************************************************/
+
+QcGestureStatisticsObject::QcGestureStatisticsObject(const QcGestureStatistics * statistics, QObject * parent)
+  : QObject(parent),
+    m_statistics(statistics),
+    m_last_state_machine_runs(0),
+    m_last_camera_updates(0),
+    m_last_number_of_events(0),
+    m_timer()
+{
+  m_timer.setInterval(1000);
+  connect(&m_timer, &QTimer::timeout, this, &QcGestureStatisticsObject::check_update);
+  m_timer.start();
+}
+
+void
+QcGestureStatisticsObject::set_update_interval(int interval)
+{
+  interval = qMax(interval, 1);
+  if (interval == m_timer.interval())
+    return;
+  m_timer.setInterval(interval);
+  emit update_intervalChanged();
+}
+
+void
+QcGestureStatisticsObject::check_update()
+{
+  // the statistics can be reset, thus compare for inequality
+  quint64 number_of_events = m_statistics->number_of_events();
+  if (m_statistics->m_state_machine_runs == m_last_state_machine_runs
+      && m_statistics->m_camera_updates == m_last_camera_updates
+      && number_of_events == m_last_number_of_events)
+    return;
+  m_last_state_machine_runs = m_statistics->m_state_machine_runs;
+  m_last_camera_updates = m_statistics->m_camera_updates;
+  m_last_number_of_events = number_of_events;
+  emit updated();
+}
+
+// QT_END_NAMESPACE
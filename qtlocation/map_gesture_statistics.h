@@ -0,0 +1,162 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_STATISTICS_H
+#define MAP_GESTURE_STATISTICS_H
+
+/**************************************************************************************************/
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+/* Cost counters of a gesture area.
+ *
+ * The counters are updated inline by the gesture area and cost a few increments per event.
+ * Durations are measured with the monotonic clock.  The input latency is the time from the
+ * timestamp of the input event to the commit of the camera, it relies on event timestamps
+ * from the monotonic clock, which is the case of the Qt platform plugins, else the samples
+ * are discarded.
+ */
+struct QcGestureStatistics
+{
+  enum EventType {
+    TouchEvent,
+    MousePressEvent,
+    MouseMoveEvent,
+    MouseReleaseEvent,
+    WheelEvent,
+    UngrabEvent,
+    NumberOfEventTypes
+  };
+
+  quint64 m_events[NumberOfEventTypes] = {};
+  quint64 m_state_machine_runs = 0;
+  quint64 m_camera_updates = 0;
+  quint64 m_flicks_started = 0;
+  quint64 m_flicks_aborted = 0; // by a new touch or when the flick is disabled
+
+  qint64 m_update_time_total = 0; // [ns]
+  qint64 m_update_time_max = 0; // [ns]
+
+  quint64 m_input_latency_samples = 0;
+  qint64 m_input_latency_total = 0; // [ms]
+  qint64 m_input_latency_max = 0; // [ms]
+
+  quint64 number_of_events() const;
+  double average_update_time() const; // [ns]
+  double average_input_latency() const; // [ms]
+
+  void count_event(EventType type) { m_events[type]++; }
+  void add_update_time(qint64 time);
+  void add_input_latency(quint64 input_timestamp);
+
+  void reset() { *this = QcGestureStatistics(); }
+  QString to_string() const;
+};
+
+/**************************************************************************************************/
+
+/* QML view on the statistics of a gesture area.
+ *
+ * The statistics are read directly, the updated() signal is emitted at most every
+ * update_interval when they changed, so that a dashboard binding is not evaluated for each
+ * input event.
+ */
+class QcGestureStatisticsObject : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(int update_interval READ update_interval WRITE set_update_interval NOTIFY update_intervalChanged)
+  Q_PROPERTY(qreal touch_events READ touch_events NOTIFY updated)
+  Q_PROPERTY(qreal mouse_press_events READ mouse_press_events NOTIFY updated)
+  Q_PROPERTY(qreal mouse_move_events READ mouse_move_events NOTIFY updated)
+  Q_PROPERTY(qreal mouse_release_events READ mouse_release_events NOTIFY updated)
+  Q_PROPERTY(qreal wheel_events READ wheel_events NOTIFY updated)
+  Q_PROPERTY(qreal ungrab_events READ ungrab_events NOTIFY updated)
+  Q_PROPERTY(qreal state_machine_runs READ state_machine_runs NOTIFY updated)
+  Q_PROPERTY(qreal camera_updates READ camera_updates NOTIFY updated)
+  Q_PROPERTY(qreal flicks_started READ flicks_started NOTIFY updated)
+  Q_PROPERTY(qreal flicks_aborted READ flicks_aborted NOTIFY updated)
+  Q_PROPERTY(qreal average_update_time READ average_update_time NOTIFY updated) // [us]
+  Q_PROPERTY(qreal max_update_time READ max_update_time NOTIFY updated) // [us]
+  Q_PROPERTY(qreal average_input_latency READ average_input_latency NOTIFY updated) // [ms]
+  Q_PROPERTY(qreal max_input_latency READ max_input_latency NOTIFY updated) // [ms]
+
+public:
+  QcGestureStatisticsObject(const QcGestureStatistics * statistics, QObject * parent = nullptr);
+
+  int update_interval() const { return m_timer.interval(); } // [ms]
+  void set_update_interval(int interval);
+
+  // counters are exposed as real, QML int is 32-bit
+  qreal touch_events() const { return m_statistics->m_events[QcGestureStatistics::TouchEvent]; }
+  qreal mouse_press_events() const { return m_statistics->m_events[QcGestureStatistics::MousePressEvent]; }
+  qreal mouse_move_events() const { return m_statistics->m_events[QcGestureStatistics::MouseMoveEvent]; }
+  qreal mouse_release_events() const { return m_statistics->m_events[QcGestureStatistics::MouseReleaseEvent]; }
+  qreal wheel_events() const { return m_statistics->m_events[QcGestureStatistics::WheelEvent]; }
+  qreal ungrab_events() const { return m_statistics->m_events[QcGestureStatistics::UngrabEvent]; }
+  qreal state_machine_runs() const { return m_statistics->m_state_machine_runs; }
+  qreal camera_updates() const { return m_statistics->m_camera_updates; }
+  qreal flicks_started() const { return m_statistics->m_flicks_started; }
+  qreal flicks_aborted() const { return m_statistics->m_flicks_aborted; }
+  qreal average_update_time() const { return m_statistics->average_update_time() / 1000.; }
+  qreal max_update_time() const { return m_statistics->m_update_time_max / 1000.; }
+  qreal average_input_latency() const { return m_statistics->average_input_latency(); }
+  qreal max_input_latency() const { return m_statistics->m_input_latency_max; }
+
+  Q_INVOKABLE QString to_string() const { return m_statistics->to_string(); }
+
+signals:
+  void updated();
+  void update_intervalChanged();
+
+private:
+  void check_update();
+
+private:
+  const QcGestureStatistics * m_statistics;
+  quint64 m_last_state_machine_runs;
+  quint64 m_last_camera_updates;
+  quint64 m_last_number_of_events;
+  QTimer m_timer;
+};
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_STATISTICS_H
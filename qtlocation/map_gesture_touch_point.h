@@ -0,0 +1,304 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_TOUCH_POINT_H
+#define MAP_GESTURE_TOUCH_POINT_H
+
+/**************************************************************************************************/
+
+#include "geometry/vector.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QEventPoint>
+#include <QMouseEvent>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+/* Subset of a QEventPoint read by the gesture state machines.
+ *
+ * QEventPoint is implicitly shared and carries a lot of data we don't use (pressure, ellipse,
+ * velocity, device...), copying it on each event is a heap allocation.
+ */
+struct QcTouchPoint
+{
+  QcTouchPoint()
+    : m_id(-1),
+      m_state(QEventPoint::State::Unknown),
+      m_timestamp(0)
+  {}
+
+  void set(const QEventPoint & point) {
+    m_id = point.id();
+    m_position = point.position();
+    m_scene_position = point.scenePosition();
+    m_state = point.state();
+    m_timestamp = point.timestamp();
+  }
+
+  // Synthesise a point from a mouse event
+  void set(const QMouseEvent * event, QEventPoint::State state) {
+    m_id = 0;
+    m_position = event->position();
+    m_scene_position = event->scenePosition();
+    m_state = state;
+    m_timestamp = event->timestamp();
+  }
+
+  int id() const { return m_id; }
+  const QcVectorDouble & position() const { return m_position; } // relative to the item
+  const QcVectorDouble & scene_position() const { return m_scene_position; } // relative to the window
+  QEventPoint::State state() const { return m_state; }
+  quint64 timestamp() const { return m_timestamp; } // [ms]
+
+  int m_id;
+  QcVectorDouble m_position;
+  QcVectorDouble m_scene_position;
+  QEventPoint::State m_state;
+  quint64 m_timestamp;
+};
+
+/**************************************************************************************************/
+
+/* Fixed capacity array of touch points stored inline.
+ *
+ * Points beyond the capacity are dropped, a map gesture never uses more than a few fingers.
+ */
+template <int N>
+class QcTouchPointBuffer
+{
+public:
+  static constexpr int capacity = N;
+
+  QcTouchPointBuffer()
+    : m_count(0)
+  {}
+
+  int count() const { return m_count; }
+  bool isEmpty() const { return m_count == 0; }
+  bool is_full() const { return m_count == N; }
+
+  void clear() { m_count = 0; }
+
+  const QcTouchPoint & at(int i) const { return m_points[i]; }
+  const QcTouchPoint & first() const { return m_points[0]; }
+
+  const QcTouchPoint * begin() const { return m_points; }
+  const QcTouchPoint * end() const { return m_points + m_count; }
+
+  // Return the slot to fill, or nullptr if the buffer is full
+  QcTouchPoint * append() {
+    if (m_count == N)
+      return nullptr;
+    return &m_points[m_count++];
+  }
+
+  bool append(const QcTouchPoint & point) {
+    QcTouchPoint * slot = append();
+    if (slot)
+      *slot = point;
+    return slot;
+  }
+
+  bool append(const QEventPoint & point) {
+    QcTouchPoint * slot = append();
+    if (slot)
+      slot->set(point);
+    return slot;
+  }
+
+  void sort_by_id() {
+    std::sort(m_points, m_points + m_count,
+              [](const QcTouchPoint & p1, const QcTouchPoint & p2) { return p1.m_id < p2.m_id; });
+  }
+
+private:
+  QcTouchPoint m_points[N];
+  int m_count;
+};
+
+// Maximum number of touch points tracked by the gesture area
+constexpr int QC_MAXIMUM_NUMBER_OF_TOUCH_POINTS = 10;
+
+typedef QcTouchPointBuffer<QC_MAXIMUM_NUMBER_OF_TOUCH_POINTS> QcTouchPoints;
+
+/**************************************************************************************************/
+
+/* Centroid, spread and angle of N touch points.
+ *
+ * The positions are stored in a structure-of-arrays layout, the reductions are plain loops
+ * over the coordinate arrays that the compiler vectorises, thus a three or four finger gesture
+ * costs the same as a two finger one.
+ *
+ *   - the centroid is the mean position,
+ *   - the spread is twice the mean distance to the centroid,
+ *   - the angle is the angle of the reference configuration plus the rotation that best fits
+ *     the reference offsets to the current ones (least squares), in the range +- 180.
+ *
+ * For two points, the spread is the distance between the points and the angle is the
+ * orientation of p2 - p1, thus the two finger gestures are unchanged.
+ *
+ * The reference is taken when the set of points changes, e.g. a finger is added or lifted,
+ * the spread is then scaled and the angle offset so that they don't jump.  The spread is
+ * scaled rather than offset, so that the pinch zoom, which is a ratio of spreads, keeps the
+ * same rate after the change.
+ */
+template <int N>
+class QcTouchPointGeometry
+{
+public:
+  QcTouchPointGeometry()
+    : m_count(0),
+      m_timestamp(0),
+      m_spread(0),
+      m_angle(0),
+      m_spread_scale(1),
+      m_reference_angle(0)
+  {}
+
+  void clear() { m_count = 0; }
+
+  int count() const { return m_count; }
+  const QcVectorDouble & centroid() const { return m_centroid; }
+  double spread() const { return m_spread; }
+  double angle() const { return m_angle; } // [deg]
+  quint64 timestamp() const { return m_timestamp; } // latest timestamp [ms]
+
+  // Return true if the points have the same ids than the last update, points must be sorted by id
+  bool has_same_points(const QcTouchPointBuffer<N> & points) const {
+    if (points.count() != m_count)
+      return false;
+    for (int i = 0; i < m_count; i++)
+      if (points.at(i).id() != m_ids[i])
+        return false;
+    return true;
+  }
+
+  // position is a functor returning the position of a QcTouchPoint in the item frame
+  template <typename F>
+  void update(const QcTouchPointBuffer<N> & points, F position) {
+    bool same_points = has_same_points(points);
+    int previous_count = m_count;
+
+    // Gather
+    m_count = points.count();
+    m_timestamp = 0;
+    for (int i = 0; i < m_count; i++) {
+      const QcTouchPoint & point = points.at(i);
+      QcVectorDouble p = position(point);
+      m_ids[i] = point.id();
+      m_x[i] = p.x();
+      m_y[i] = p.y();
+      m_timestamp = qMax(m_timestamp, point.timestamp());
+    }
+    if (!m_count)
+      return;
+
+    // Centroid
+    double sum_x = 0;
+    double sum_y = 0;
+    for (int i = 0; i < m_count; i++) {
+      sum_x += m_x[i];
+      sum_y += m_y[i];
+    }
+    double scale = 1. / m_count;
+    double centroid_x = sum_x * scale;
+    double centroid_y = sum_y * scale;
+    m_centroid = QcVectorDouble(centroid_x, centroid_y);
+
+    // Offsets to the centroid and spread
+    double sum_distance = 0;
+    for (int i = 0; i < m_count; i++) {
+      m_dx[i] = m_x[i] - centroid_x;
+      m_dy[i] = m_y[i] - centroid_y;
+      sum_distance += std::sqrt(m_dx[i] * m_dx[i] + m_dy[i] * m_dy[i]);
+    }
+    double spread = 2 * sum_distance * scale;
+
+    if (!same_points) {
+      // Take a new reference
+      std::copy(m_dx, m_dx + m_count, m_reference_dx);
+      std::copy(m_dy, m_dy + m_count, m_reference_dy);
+      if (previous_count >= 2 && m_count >= 2) {
+        // a finger was added or lifted during the gesture
+        m_spread_scale = spread > 0 ? m_spread / spread : 1;
+        m_reference_angle = m_angle;
+      } else {
+        m_spread_scale = 1;
+        m_reference_angle = m_count >= 2 ? QcVectorDouble(m_x[1] - m_x[0], m_y[1] - m_y[0]).orientation() : 0;
+      }
+    }
+    m_spread = spread * m_spread_scale;
+
+    // Rotation from the reference: atan2(sum of cross products, sum of dot products)
+    double sum_dot = 0;
+    double sum_cross = 0;
+    for (int i = 0; i < m_count; i++) {
+      sum_dot += m_reference_dx[i] * m_dx[i] + m_reference_dy[i] * m_dy[i];
+      sum_cross += m_reference_dx[i] * m_dy[i] - m_reference_dy[i] * m_dx[i];
+    }
+    // use orientation() so as to follow the angle convention of the vector
+    double angle = m_reference_angle + QcVectorDouble(sum_dot, sum_cross).orientation();
+    while (angle > 180)
+      angle -= 360;
+    while (angle <= -180)
+      angle += 360;
+    m_angle = angle;
+  }
+
+private:
+  alignas(32) double m_x[N];
+  alignas(32) double m_y[N];
+  alignas(32) double m_dx[N]; // offsets to the centroid
+  alignas(32) double m_dy[N];
+  alignas(32) double m_reference_dx[N];
+  alignas(32) double m_reference_dy[N];
+  int m_ids[N];
+  int m_count;
+  quint64 m_timestamp;
+  QcVectorDouble m_centroid;
+  double m_spread;
+  double m_angle;
+  double m_spread_scale;
+  double m_reference_angle;
+};
+
+typedef QcTouchPointGeometry<QC_MAXIMUM_NUMBER_OF_TOUCH_POINTS> QcTouchPointsGeometry;
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_TOUCH_POINT_H
@@ -0,0 +1,247 @@
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#include "map_gesture_trace.h"
+
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+// Disabled by default, the gesture traces are very verbose
+Q_LOGGING_CATEGORY(qtcarto_gesture, "qtcarto.gesture", QtWarningMsg)
+
+/**************************************************************************************************/
+
+quint64
+QcGestureTraceBuffer::now()
+{
+  static QElapsedTimer clock = [] { QElapsedTimer timer; timer.start(); return timer; }();
+  return clock.nsecsElapsed();
+}
+
+QcGestureTraceBuffer::QcGestureTraceBuffer(int capacity_log2)
+  : m_slots(new Slot[size_t(1) << capacity_log2]),
+    m_mask((quint64(1) << capacity_log2) - 1),
+    m_head(0)
+{
+  for (quint64 i = 0; i <= m_mask; i++)
+    m_slots[i].m_sequence.store(0, std::memory_order_relaxed);
+}
+
+void
+QcGestureTraceBuffer::record(const QcGestureTraceRecord & record)
+{
+  quint64 n = m_head.fetch_add(1, std::memory_order_relaxed);
+  Slot & slot = m_slots[n & m_mask];
+  slot.m_sequence.store(2*n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.m_record = record;
+  slot.m_sequence.store(2*n + 2, std::memory_order_release);
+}
+
+void
+QcGestureTraceBuffer::trace_transition(QcGestureTraceRecord::Machine machine, int from, int to)
+{
+  QcGestureTraceRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.m_timestamp = now();
+  record.m_type = QcGestureTraceRecord::StateTransition;
+  record.m_machine = machine;
+  record.m_from = from;
+  record.m_to = to;
+  this->record(record);
+}
+
+void
+QcGestureTraceBuffer::trace_camera(double longitude, double latitude, double zoom_level, double bearing, double tilt)
+{
+  QcGestureTraceRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.m_timestamp = now();
+  record.m_type = QcGestureTraceRecord::CameraUpdate;
+  record.m_values[0] = longitude;
+  record.m_values[1] = latitude;
+  record.m_values[2] = zoom_level;
+  record.m_values[3] = bearing;
+  record.m_values[4] = tilt;
+  this->record(record);
+}
+
+void
+QcGestureTraceBuffer::trace_flick_start(double velocity_x, double velocity_y, int duration)
+{
+  QcGestureTraceRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.m_timestamp = now();
+  record.m_type = QcGestureTraceRecord::FlickStart;
+  record.m_machine = QcGestureTraceRecord::FlickMachine;
+  record.m_values[0] = velocity_x;
+  record.m_values[1] = velocity_y;
+  record.m_values[2] = duration;
+  this->record(record);
+}
+
+void
+QcGestureTraceBuffer::trace_flick_stop()
+{
+  QcGestureTraceRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.m_timestamp = now();
+  record.m_type = QcGestureTraceRecord::FlickStop;
+  record.m_machine = QcGestureTraceRecord::FlickMachine;
+  this->record(record);
+}
+
+QVector<QcGestureTraceRecord>
+QcGestureTraceBuffer::snapshot() const
+{
+  QVector<QcGestureTraceRecord> records;
+
+  quint64 head = m_head.load(std::memory_order_acquire);
+  quint64 capacity = m_mask + 1;
+  quint64 start = head > capacity ? head - capacity : 0;
+  records.reserve(head - start);
+
+  for (quint64 n = start; n < head; n++) {
+    const Slot & slot = m_slots[n & m_mask];
+    quint64 sequence = slot.m_sequence.load(std::memory_order_acquire);
+    if (sequence != 2*n + 2)
+      continue; // not yet written or already overwritten
+    QcGestureTraceRecord record = slot.m_record;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.m_sequence.load(std::memory_order_relaxed) != sequence)
+      continue; // overwritten while copied
+    records.append(record);
+  }
+
+  return records;
+}
+
+// Keep in sync with the state enums of QcMapGestureArea and QcGestureArbiter
+static const char * machine_names[QcGestureTraceRecord::NumberOfMachines] = {
+  "touch points", "pinch", "rotation", "tilt", "flick", "transform",
+};
+
+static const char * state_names[QcGestureTraceRecord::NumberOfMachines][3] = {
+  {"TouchPoints0", "TouchPoints1", "TouchPoints2"},
+  {"PinchInactive", "PinchInactiveTwoPoints", "PinchActive"},
+  {"RotationInactive", "RotationInactiveTwoPoints", "RotationActive"},
+  {"TiltInactive", "TiltInactiveTwoPoints", "TiltActive"},
+  {"FlickInactive", "PanActive", "FlickActive"},
+  {"TransformInactive", "TransformInactiveTwoPoints", "TransformActive"},
+};
+
+static const char *
+state_name(int machine, int state)
+{
+  if (machine < 0 || machine >= QcGestureTraceRecord::NumberOfMachines || state < 0 || state > 2)
+    return "?";
+  return state_names[machine][state];
+}
+
+/// Return the trace in the Chrome trace event format, which is also read by Perfetto.
+/// Each state machine has its own track, the camera is traced as counters.
+QByteArray
+QcGestureTraceBuffer::to_chrome_trace() const
+{
+  const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+  const QByteArray common = ", \"pid\": " + pid + ", \"tid\": ";
+
+  QByteArray json;
+  json += "{\"traceEvents\": [\n";
+
+  for (int i = 0; i < QcGestureTraceRecord::NumberOfMachines; i++) {
+    json += "{\"name\": \"thread_name\", \"ph\": \"M\"" + common + QByteArray::number(i + 1);
+    json += ", \"args\": {\"name\": \"gesture ";
+    json += machine_names[i];
+    json += "\"}},\n";
+  }
+
+  for (const auto & record : snapshot()) {
+    QByteArray ts = QByteArray::number(record.m_timestamp / 1000.0, 'f', 3); // [us]
+    QByteArray tid = QByteArray::number(record.m_machine + 1);
+    switch (record.m_type) {
+    case QcGestureTraceRecord::StateTransition:
+      json += "{\"name\": \"";
+      json += state_name(record.m_machine, record.m_to);
+      json += "\", \"ph\": \"i\", \"s\": \"t\", \"ts\": " + ts + common + tid;
+      json += ", \"args\": {\"from\": \"";
+      json += state_name(record.m_machine, record.m_from);
+      json += "\"}},\n";
+      break;
+    case QcGestureTraceRecord::CameraUpdate:
+      json += "{\"name\": \"camera\", \"ph\": \"C\", \"ts\": " + ts + common + "0";
+      json += ", \"args\": {\"zoom_level\": " + QByteArray::number(record.m_values[2], 'g', 10);
+      json += ", \"bearing\": " + QByteArray::number(record.m_values[3], 'g', 10);
+      json += ", \"tilt\": " + QByteArray::number(record.m_values[4], 'g', 10);
+      json += "}},\n";
+      json += "{\"name\": \"camera center\", \"ph\": \"C\", \"ts\": " + ts + common + "0";
+      json += ", \"args\": {\"longitude\": " + QByteArray::number(record.m_values[0], 'g', 10);
+      json += ", \"latitude\": " + QByteArray::number(record.m_values[1], 'g', 10);
+      json += "}},\n";
+      break;
+    case QcGestureTraceRecord::FlickStart:
+      json += "{\"name\": \"flick\", \"ph\": \"B\", \"ts\": " + ts + common + tid;
+      json += ", \"args\": {\"velocity_x\": " + QByteArray::number(record.m_values[0], 'g', 10);
+      json += ", \"velocity_y\": " + QByteArray::number(record.m_values[1], 'g', 10);
+      json += ", \"duration_ms\": " + QByteArray::number(record.m_values[2], 'g', 10);
+      json += "}},\n";
+      break;
+    case QcGestureTraceRecord::FlickStop:
+      json += "{\"name\": \"flick\", \"ph\": \"E\", \"ts\": " + ts + common + tid + "},\n";
+      break;
+    }
+  }
+
+  // JSON doesn't permit a trailing comma
+  if (json.endsWith(",\n"))
+    json.chop(2);
+  json += "\n], \"displayTimeUnit\": \"ms\"}\n";
+
+  return json;
+}
+
+bool
+QcGestureTraceBuffer::dump(const QString & path) const
+{
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+  QByteArray json = to_chrome_trace();
+  return file.write(json) == json.size();
+}
+
+// QT_END_NAMESPACE
@@ -0,0 +1,160 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_TRACE_H
+#define MAP_GESTURE_TRACE_H
+
+/**************************************************************************************************/
+
+#include <atomic>
+#include <memory>
+
+#include <QByteArray>
+#include <QLoggingCategory>
+#include <QString>
+#include <QVector>
+
+/**************************************************************************************************/
+
+/* Gesture tracing
+ *
+ * The gesture code runs for each input event, its tracing must cost nothing when disabled.
+ *
+ * QC_GESTURE_TRACE_LEVEL selects at compile time the traces which are built:
+ *   0: none, the trace statements are dead code removed by the compiler (default for release builds)
+ *   1: state transitions and configuration changes, see qQCGestureInfo()
+ *   2: also function entries and input events, see qQCGestureTrace() (default for debug builds)
+ *
+ * At run time, the traces are emitted to the "qtcarto.gesture" logging category, which is
+ * disabled by default.  The category is checked before the QDebug stream is created and
+ * before the arguments are evaluated, e.g. QT_LOGGING_RULES="qtcarto.gesture.debug=true".
+ */
+
+#ifndef QC_GESTURE_TRACE_LEVEL
+# ifdef QT_NO_DEBUG
+#  define QC_GESTURE_TRACE_LEVEL 0
+# else
+#  define QC_GESTURE_TRACE_LEVEL 2
+# endif
+#endif
+
+Q_DECLARE_LOGGING_CATEGORY(qtcarto_gesture)
+
+// Same construct as qCDebug, the for statement avoids the dangling else issue
+#define QC_GESTURE_TRACE_STREAM(level)                                  \
+  for (bool qc_trace_enabled = QC_GESTURE_TRACE_LEVEL >= level && qtcarto_gesture().isDebugEnabled(); \
+       qc_trace_enabled;                                                \
+       qc_trace_enabled = false)                                        \
+    QMessageLogger(QT_MESSAGELOG_FILE, QT_MESSAGELOG_LINE, QT_MESSAGELOG_FUNC, \
+                   qtcarto_gesture().categoryName()).debug() << Q_FUNC_INFO
+
+#define qQCGestureInfo() QC_GESTURE_TRACE_STREAM(1)
+#define qQCGestureTrace() QC_GESTURE_TRACE_STREAM(2)
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/* Typed trace record of the gesture area
+ *
+ * Unlike the text traces, records are cheap enough to be always on in production builds,
+ * they are stored in a QcGestureTraceBuffer and dumped on demand.
+ */
+struct QcGestureTraceRecord
+{
+  enum Type : quint8 {
+    StateTransition, // machine, from, to
+    CameraUpdate,    // values: longitude, latitude, zoom level, bearing, tilt
+    FlickStart,      // values: velocity x, y [px/s], duration [ms]
+    FlickStop
+  };
+
+  // State machines of the gesture area
+  enum Machine : quint8 {
+    TouchPointMachine,
+    PinchMachine,
+    RotationMachine,
+    TiltMachine,
+    FlickMachine,
+    TransformMachine,
+    NumberOfMachines
+  };
+
+  quint64 m_timestamp; // [ns] see QcGestureTraceBuffer::now()
+  Type m_type;
+  Machine m_machine;
+  qint16 m_from;
+  qint16 m_to;
+  double m_values[5];
+};
+
+/* Lock-free ring buffer of trace records
+ *
+ * Writers never block nor allocate: a slot is reserved by an atomic increment, and a sequence
+ * number per slot lets a concurrent reader detect the slots overwritten while it copies them.
+ * When the buffer is full, the oldest records are overwritten.
+ */
+class QcGestureTraceBuffer
+{
+public:
+  explicit QcGestureTraceBuffer(int capacity_log2 = 12);
+
+  int capacity() const { return int(m_mask + 1); }
+  quint64 number_of_records() const { return m_head.load(std::memory_order_relaxed); } // since creation
+
+  void record(const QcGestureTraceRecord & record);
+
+  void trace_transition(QcGestureTraceRecord::Machine machine, int from, int to);
+  void trace_camera(double longitude, double latitude, double zoom_level, double bearing, double tilt);
+  void trace_flick_start(double velocity_x, double velocity_y, int duration);
+  void trace_flick_stop();
+
+  QVector<QcGestureTraceRecord> snapshot() const; // oldest first
+  QByteArray to_chrome_trace() const; // Chrome trace / Perfetto JSON
+  bool dump(const QString & path) const;
+
+  static quint64 now(); // monotonic clock [ns]
+
+private:
+  struct Slot {
+    std::atomic<quint64> m_sequence; // 2n+1 while record n is written, 2n+2 once written
+    QcGestureTraceRecord m_record;
+  };
+
+  std::unique_ptr<Slot[]> m_slots;
+  quint64 m_mask;
+  std::atomic<quint64> m_head;
+};
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_TRACE_H
@@ -0,0 +1,180 @@
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#include "map_gesture_velocity_tracker.h"
+
+#include <cmath>
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+QcVelocityTracker::QcVelocityTracker(Estimator estimator)
+  : m_estimator(estimator),
+    m_head(capacity - 1),
+    m_count(0)
+{}
+
+void
+QcVelocityTracker::add_sample(quint64 timestamp, const QcVectorDouble & position)
+{
+  if (m_count) {
+    Sample & latest = m_samples[m_head];
+    if (timestamp <= latest.m_timestamp) {
+      // same input frame, or out of order timestamp
+      latest.m_position = position;
+      return;
+    }
+    if (timestamp - latest.m_timestamp > maximum_pause)
+      m_count = 0; // the pointer stopped, start a new movement
+  }
+
+  m_head = (m_head + 1) % capacity;
+  m_samples[m_head] = {timestamp, position};
+  m_count = qMin(m_count + 1, capacity);
+}
+
+/// Return the number of samples within the horizon
+int
+QcVelocityTracker::number_of_usable_samples() const
+{
+  quint64 latest_timestamp = sample(0).m_timestamp;
+  int n = 1;
+  while (n < m_count && latest_timestamp - sample(n).m_timestamp <= horizon)
+    n++;
+  return n;
+}
+
+QcVectorDouble
+QcVelocityTracker::velocity(quint64 timestamp) const
+{
+  if (m_count < 2)
+    return QcVectorDouble();
+  if (timestamp > sample(0).m_timestamp && timestamp - sample(0).m_timestamp > maximum_pause)
+    return QcVectorDouble(); // the pointer stopped before the release
+
+  int n = number_of_usable_samples();
+  if (n < 2)
+    return QcVectorDouble();
+
+  switch (m_estimator) {
+  case TwoPointEstimator:
+    return two_point_velocity(n);
+  case ImpulseEstimator:
+    return impulse_velocity(n);
+  case LeastSquaresEstimator:
+  default:
+    return least_squares_velocity(n);
+  }
+}
+
+QcVectorDouble
+QcVelocityTracker::two_point_velocity(int n) const
+{
+  const Sample & latest = sample(0);
+  const Sample & oldest = sample(n - 1);
+  double dt = (latest.m_timestamp - oldest.m_timestamp) / 1000.; // [s]
+  return (latest.m_position - oldest.m_position) / dt;
+}
+
+/// Weighted least squares fit of x(t) and y(t) by a line, the weight decreases linearly
+/// from 1 for the latest sample to .5 at the horizon.
+QcVectorDouble
+QcVelocityTracker::least_squares_velocity(int n) const
+{
+  const quint64 latest_timestamp = sample(0).m_timestamp;
+
+  double sum_w = 0, sum_t = 0;
+  QcVectorDouble sum_p;
+  for (int i = 0; i < n; i++) {
+    const Sample & s = sample(i);
+    double age = (latest_timestamp - s.m_timestamp) / 1000.; // [s]
+    double w = 1. - .5 * age / (horizon / 1000.);
+    sum_w += w;
+    sum_t += w * -age;
+    sum_p += s.m_position * w;
+  }
+  double mean_t = sum_t / sum_w;
+  QcVectorDouble mean_p = sum_p / sum_w;
+
+  double sum_tt = 0;
+  QcVectorDouble sum_tp;
+  for (int i = 0; i < n; i++) {
+    const Sample & s = sample(i);
+    double age = (latest_timestamp - s.m_timestamp) / 1000.;
+    double w = 1. - .5 * age / (horizon / 1000.);
+    double dt = -age - mean_t;
+    sum_tt += w * dt * dt;
+    sum_tp += (s.m_position - mean_p) * (w * dt);
+  }
+
+  if (sum_tt <= 0)
+    return QcVectorDouble();
+  return sum_tp / sum_tt;
+}
+
+static double
+kinetic_energy_to_velocity(double work)
+{
+  // E = 1/2 m v^2 with m = 1
+  return std::copysign(std::sqrt(2 * std::fabs(work)), work);
+}
+
+static double
+impulse_velocity_1d(const double * t, const double * x, int n)
+{
+  // samples are ordered from the oldest to the latest
+  double work = 0;
+  for (int i = 1; i < n; i++) {
+    double v_previous = kinetic_energy_to_velocity(work);
+    double v_current = (x[i] - x[i-1]) / (t[i] - t[i-1]);
+    work += (v_current - v_previous) * std::fabs(v_current);
+    if (i == 1)
+      work *= .5; // the pointer was at rest before the first sample
+  }
+  return kinetic_energy_to_velocity(work);
+}
+
+QcVectorDouble
+QcVelocityTracker::impulse_velocity(int n) const
+{
+  double t[capacity];
+  double x[capacity];
+  double y[capacity];
+  for (int i = 0; i < n; i++) {
+    const Sample & s = sample(n - 1 - i);
+    t[i] = s.m_timestamp / 1000.; // [s]
+    x[i] = s.m_position.x();
+    y[i] = s.m_position.y();
+  }
+  return QcVectorDouble(impulse_velocity_1d(t, x, n), impulse_velocity_1d(t, y, n));
+}
+
+// QT_END_NAMESPACE
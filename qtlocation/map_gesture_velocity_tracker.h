@@ -0,0 +1,109 @@
+// -*- mode: c++ -*-
+
+/***************************************************************************************************
+ **
+ ** $QTCARTO_BEGIN_LICENSE:GPL3$
+ **
+ ** Copyright (C) 2016 Fabrice Salvaire
+ ** Contact: http://www.fabrice-salvaire.fr
+ **
+ ** This file is part of the Alpine Toolkit software.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ** $QTCARTO_END_LICENSE$
+ **
+ ***************************************************************************************************/
+
+/**************************************************************************************************/
+
+#ifndef MAP_GESTURE_VELOCITY_TRACKER_H
+#define MAP_GESTURE_VELOCITY_TRACKER_H
+
+/**************************************************************************************************/
+
+#include "geometry/vector.h"
+
+/**************************************************************************************************/
+
+// QT_BEGIN_NAMESPACE
+
+/**************************************************************************************************/
+
+/* Estimate the velocity of a pointer from its recent positions.
+ *
+ * Positions are stored with the timestamp of their input event in a ring buffer, thus the
+ * estimation doesn't depend on the time at which the events are processed.  Only the samples
+ * within the horizon before the latest one are used, and a pause longer than maximum_pause
+ * means the pointer stopped.
+ *
+ * Estimators:
+ *   TwoPointEstimator: displacement between the oldest and the latest sample of the horizon
+ *   LeastSquaresEstimator: slope of a linear fit weighted towards the latest samples
+ *   ImpulseEstimator: velocity giving the kinetic energy of the work done by the pointer,
+ *                     the impulse strategy of Android
+ */
+class QcVelocityTracker
+{
+public:
+  enum Estimator {
+    TwoPointEstimator,
+    LeastSquaresEstimator,
+    ImpulseEstimator
+  };
+
+  static constexpr int capacity = 20;
+  static constexpr int horizon = 100; // [ms]
+  static constexpr int maximum_pause = 40; // [ms]
+
+public:
+  QcVelocityTracker(Estimator estimator = LeastSquaresEstimator);
+
+  Estimator estimator() const { return m_estimator; }
+  void set_estimator(Estimator estimator) { m_estimator = estimator; }
+
+  void clear() { m_count = 0; }
+  int count() const { return m_count; }
+
+  void add_sample(quint64 timestamp, const QcVectorDouble & position);
+
+  // Velocity at the given time [px/s], null if the pointer stopped
+  QcVectorDouble velocity(quint64 timestamp) const;
+
+private:
+  struct Sample {
+    quint64 m_timestamp; // [ms]
+    QcVectorDouble m_position;
+  };
+
+  // i-th sample from the latest one
+  const Sample & sample(int i) const { return m_samples[(m_head - i + capacity) % capacity]; }
+  int number_of_usable_samples() const;
+
+  QcVectorDouble two_point_velocity(int n) const;
+  QcVectorDouble least_squares_velocity(int n) const;
+  QcVectorDouble impulse_velocity(int n) const;
+
+private:
+  Estimator m_estimator;
+  Sample m_samples[capacity];
+  int m_head; // latest sample
+  int m_count;
+};
+
+// QT_END_NAMESPACE
+
+/**************************************************************************************************/
+
+#endif // MAP_GESTURE_VELOCITY_TRACKER_H
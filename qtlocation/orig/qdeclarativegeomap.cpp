@@ -44,16 +44,27 @@
 #include "qgeomap_p.h"
 #include "qdeclarativegeomapparameter_p.h"
 #include "qgeomapobject_p.h"
+#include "qgeotiledmap_p.h"
+#include "qgeotilerequestmanager_p.h"
+#include "qgeocameratiles_p.h"
+#include "qgeoprojection_p.h"
 #include <QtPositioning/QGeoCircle>
 #include <QtPositioning/QGeoRectangle>
 #include <QtPositioning/QGeoPath>
 #include <QtPositioning/QGeoPolygon>
+#include <QtPositioning/private/qwebmercator_p.h>
 #include <QtQuick/QQuickWindow>
 #include <QtQuick/QSGRectangleNode>
 #include <QtQuick/private/qquickwindow_p.h>
 #include <QtQml/qqmlinfo.h>
 #include <QtQuick/private/qquickitem_p.h>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QMetaMethod>
+#include <QtCore/QTextStream>
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 #ifndef M_PI
 #define M_PI 3.141592653589793238463
@@ -224,6 +235,9 @@ QDeclarativeGeoMap::QDeclarativeGeoMap(QQuickItem *parent)
     m_maximumTilt = m_cameraCapabilities.maximumTilt();
     m_minimumFieldOfView = m_cameraCapabilities.minimumFieldOfView();
     m_maximumFieldOfView = m_cameraCapabilities.maximumFieldOfView();
+
+    m_prefetchTimer.setSingleShot(true);
+    connect(&m_prefetchTimer, &QTimer::timeout, this, &QDeclarativeGeoMap::schedulePrefetch);
 }
 
 QDeclarativeGeoMap::~QDeclarativeGeoMap()
@@ -708,6 +722,8 @@ void QDeclarativeGeoMap::mappingManagerInitialized()
 
 
     connect(window(), &QQuickWindow::beforeSynchronizing, this, &QDeclarativeGeoMap::updateItemToWindowTransform, Qt::DirectConnection);
+    connect(window(), &QQuickWindow::beforeSynchronizing, this, &QDeclarativeGeoMap::synchronizeInputLatency, Qt::DirectConnection);
+    connect(window(), &QQuickWindow::frameSwapped, this, &QDeclarativeGeoMap::recordInputLatency, Qt::DirectConnection);
     connect(m_map.data(), &QGeoMap::sgNodeChanged, this, &QDeclarativeGeoMap::onSGNodeChanged);
     connect(m_map.data(), &QGeoMap::cameraCapabilitiesChanged, this, &QDeclarativeGeoMap::onCameraCapabilitiesChanged);
 
@@ -881,7 +897,7 @@ void QDeclarativeGeoMap::setZoomLevel(qreal zoomLevel, bool overzoom)
         return;
 
     if (m_initialized) {
-        QGeoCameraData cameraData = m_map->cameraData();
+        QGeoCameraData cameraData = currentCameraData();
         if (cameraData.zoomLevel() == zoomLevel)
             return;
 
@@ -893,7 +909,7 @@ void QDeclarativeGeoMap::setZoomLevel(qreal zoomLevel, bool overzoom)
         QGeoCoordinate coord = cameraData.center();
         coord.setLatitude(qBound(m_minimumViewportLatitude, coord.latitude(), m_maximumViewportLatitude));
         cameraData.setCenter(coord);
-        m_map->setCameraData(cameraData);
+        setMapCameraData(cameraData);
     } else {
         const bool zlHasChanged = zoomLevel != m_cameraData.zoomLevel();
         m_cameraData.setZoomLevel(zoomLevel);
@@ -960,7 +976,7 @@ bool QDeclarativeGeoMap::isGroupNested(QDeclarativeGeoMapItemGroup *group)
 qreal QDeclarativeGeoMap::zoomLevel() const
 {
     if (m_initialized)
-        return m_map->cameraData().zoomLevel();
+        return currentCameraData().zoomLevel();
     return m_cameraData.zoomLevel();
 }
 
@@ -978,9 +994,9 @@ void QDeclarativeGeoMap::setBearing(qreal bearing)
 {
     bearing = sanitizeBearing(bearing);
     if (m_initialized) {
-        QGeoCameraData cameraData = m_map->cameraData();
+        QGeoCameraData cameraData = currentCameraData();
         cameraData.setBearing(bearing);
-        m_map->setCameraData(cameraData);
+        setMapCameraData(cameraData);
     } else {
         const bool bearingHasChanged = bearing != m_cameraData.bearing();
         m_cameraData.setBearing(bearing);
@@ -1018,14 +1034,16 @@ void QDeclarativeGeoMap::setBearing(qreal bearing, const QGeoCoordinate &coordin
             || (coordinate == currentCenter && bearing == currentBearing))
         return;
 
-    if (m_map->capabilities() & QGeoMap::SupportsSetBearing)
+    if (m_map->capabilities() & QGeoMap::SupportsSetBearing) {
+        flushPendingCameraData();
         m_map->setBearing(bearing, coordinate);
+    }
 }
 
 qreal QDeclarativeGeoMap::bearing() const
 {
     if (m_initialized)
-        return m_map->cameraData().bearing();
+        return currentCameraData().bearing();
     return m_cameraData.bearing();
 }
 
@@ -1046,9 +1064,9 @@ void QDeclarativeGeoMap::setTilt(qreal tilt)
     tilt = qBound(minimumTilt(), tilt, maximumTilt());
 
     if (m_initialized) {
-        QGeoCameraData cameraData = m_map->cameraData();
+        QGeoCameraData cameraData = currentCameraData();
         cameraData.setTilt(tilt);
-        m_map->setCameraData(cameraData);
+        setMapCameraData(cameraData);
     } else {
         const bool tiltHasChanged = tilt != m_cameraData.tilt();
         m_cameraData.setTilt(tilt);
@@ -1063,7 +1081,7 @@ void QDeclarativeGeoMap::setTilt(qreal tilt)
 qreal QDeclarativeGeoMap::tilt() const
 {
     if (m_initialized)
-        return m_map->cameraData().tilt();
+        return currentCameraData().tilt();
     return m_cameraData.tilt();
 }
 
@@ -1107,9 +1125,9 @@ void QDeclarativeGeoMap::setFieldOfView(qreal fieldOfView)
     fieldOfView = qBound(minimumFieldOfView(), fieldOfView, maximumFieldOfView());
 
     if (m_initialized) {
-        QGeoCameraData cameraData = m_map->cameraData();
+        QGeoCameraData cameraData = currentCameraData();
         cameraData.setFieldOfView(fieldOfView);
-        m_map->setCameraData(cameraData);
+        setMapCameraData(cameraData);
     } else {
         const bool fovChanged = fieldOfView != m_cameraData.fieldOfView();
         m_cameraData.setFieldOfView(fieldOfView);
@@ -1124,7 +1142,7 @@ void QDeclarativeGeoMap::setFieldOfView(qreal fieldOfView)
 qreal QDeclarativeGeoMap::fieldOfView() const
 {
     if (m_initialized)
-        return m_map->cameraData().fieldOfView();
+        return currentCameraData().fieldOfView();
     return m_cameraData.fieldOfView();
 }
 
@@ -1277,9 +1295,9 @@ void QDeclarativeGeoMap::setCenter(const QGeoCoordinate &center)
     if (m_initialized) {
         QGeoCoordinate coord(center);
         coord.setLatitude(qBound(m_minimumViewportLatitude, center.latitude(), m_maximumViewportLatitude));
-        QGeoCameraData cameraData = m_map->cameraData();
+        QGeoCameraData cameraData = currentCameraData();
         cameraData.setCenter(coord);
-        m_map->setCameraData(cameraData);
+        setMapCameraData(cameraData);
     } else {
         const bool centerHasChanged = center != m_cameraData.center();
         m_cameraData.setCenter(center);
@@ -1294,7 +1312,7 @@ void QDeclarativeGeoMap::setCenter(const QGeoCoordinate &center)
 QGeoCoordinate QDeclarativeGeoMap::center() const
 {
     if (m_initialized)
-        return m_map->cameraData().center();
+        return currentCameraData().center();
     return m_cameraData.center();
 }
 
@@ -1528,7 +1546,157 @@ void QDeclarativeGeoMap::alignCoordinateToPoint(const QGeoCoordinate &coordinate
             || !qIsFinite(point.y()))
         return;
 
-    m_map->anchorCoordinateToPoint(coordinate, point);
+    if (!hasPendingProjection()) {
+        // the anchoring is computed by the projection of the map, thus the camera
+        // changes of an open transaction must be applied first
+        flushPendingCameraData();
+        m_map->anchorCoordinateToPoint(coordinate, point);
+        return;
+    }
+
+    // Anchor with the camera of the open transaction, so that a gesture changing the zoom level,
+    // the bearing and the center in one frame still sets the camera of the map only once
+    QGeoCameraData cameraData = m_pendingCameraData;
+    QGeoProjectionWebMercator projection;
+    setupPendingProjection(projection);
+    QGeoCoordinate center = projection.anchorCoordinateToPoint(coordinate, point);
+    center.setLatitude(qBound(m_map->minimumCenterLatitudeAtZoom(cameraData), center.latitude(),
+                              m_map->maximumCenterLatitudeAtZoom(cameraData)));
+    cameraData.setCenter(center);
+    setMapCameraData(cameraData);
+}
+
+/*!
+    \internal
+
+    Opens a camera transaction.
+
+    Until the matching commitCameraUpdate(), the changes of center, zoom level, bearing,
+    tilt and field of view are accumulated and the getters return the accumulated camera.
+    The map items and the property change notifications are only updated when the outermost
+    transaction is committed, thus a gesture updating several camera parameters in one frame
+    costs a single item pass.
+
+    Transactions can be nested.
+
+    \sa commitCameraUpdate()
+*/
+void QDeclarativeGeoMap::beginCameraUpdate()
+{
+    ++m_cameraUpdateDepth;
+}
+
+/*!
+    \internal
+
+    Closes a camera transaction opened by beginCameraUpdate().
+
+    When the outermost transaction is closed, the accumulated camera is applied to the map
+    and the map items and the change notifications are updated at once.  Returns \c true
+    if the camera was changed, a transaction which didn't change the camera costs nothing.
+
+    \note Methods which rely on the projection, like toCoordinate(), apply the accumulated
+    camera to the map before to proceed, but the notifications are still delayed up to the
+    commit.  alignCoordinateToPoint() anchors with the accumulated camera of a Web Mercator map
+    without applying it.
+*/
+bool QDeclarativeGeoMap::commitCameraUpdate()
+{
+    if (m_cameraUpdateDepth <= 0) {
+        qWarning("QDeclarativeGeoMap::commitCameraUpdate called without a matching beginCameraUpdate");
+        return false;
+    }
+
+    if (--m_cameraUpdateDepth > 0)
+        return false;
+
+    if (!m_cameraChanged)
+        return false;
+    m_cameraChanged = false;
+
+    if (!m_map) {
+        m_cameraDataPending = false;
+        return false;
+    }
+
+    flushPendingCameraData();
+    onCameraDataChanged(m_map->cameraData());
+    return true;
+}
+
+bool QDeclarativeGeoMap::isCameraUpdateInProgress() const
+{
+    return m_cameraUpdateDepth > 0;
+}
+
+/*!
+    \internal
+
+    Returns the camera of the map, including the changes of an open transaction.
+*/
+QGeoCameraData QDeclarativeGeoMap::currentCameraData() const
+{
+    if (m_cameraDataPending)
+        return m_pendingCameraData;
+    return m_map->cameraData();
+}
+
+/*!
+    \internal
+
+    Applies \a cameraData to the map, or defers it to the commit if a transaction is open.
+*/
+void QDeclarativeGeoMap::setMapCameraData(const QGeoCameraData &cameraData)
+{
+    if (m_cameraUpdateDepth > 0) {
+        if (cameraData == currentCameraData())
+            return;
+        m_pendingCameraData = cameraData;
+        m_cameraDataPending = true;
+        m_cameraChanged = true;
+    } else {
+        m_map->setCameraData(cameraData);
+    }
+}
+
+/*!
+    \internal
+
+    Returns true if the camera of an open transaction can be projected with a scratch
+    projection, which is the case of the Web Mercator projection.
+*/
+bool QDeclarativeGeoMap::hasPendingProjection() const
+{
+    return m_cameraDataPending
+            && m_map->geoProjection().projectionType() == QGeoProjection::ProjectionWebMercator;
+}
+
+/*!
+    \internal
+
+    Sets up \a projection with the viewport of the map and the camera of the open transaction,
+    the map itself is only updated on commit.
+*/
+void QDeclarativeGeoMap::setupPendingProjection(QGeoProjectionWebMercator &projection) const
+{
+    projection.setViewportSize(QSize(m_map->viewportWidth(), m_map->viewportHeight()));
+    projection.setVisibleArea(m_map->visibleArea());
+    projection.setCameraData(m_pendingCameraData, true);
+}
+
+/*!
+    \internal
+
+    Applies the camera accumulated in the open transaction to the map.
+    The notifications remain deferred up to commitCameraUpdate().
+*/
+void QDeclarativeGeoMap::flushPendingCameraData()
+{
+    if (!m_cameraDataPending)
+        return;
+    m_cameraDataPending = false;
+    if (m_map)
+        m_map->setCameraData(m_pendingCameraData);
 }
 
 /*!
@@ -1541,9 +1709,15 @@ void QDeclarativeGeoMap::alignCoordinateToPoint(const QGeoCoordinate &coordinate
 */
 QGeoCoordinate QDeclarativeGeoMap::toCoordinate(const QPointF &position, bool clipToViewPort) const
 {
-    if (m_map)
+    if (m_map) {
+        // a const query must not apply the camera of an open transaction to the map
+        if (hasPendingProjection()) {
+            QGeoProjectionWebMercator projection;
+            setupPendingProjection(projection);
+            return projection.itemPositionToCoordinate(QDoubleVector2D(position), clipToViewPort);
+        }
         return m_map->geoProjection().itemPositionToCoordinate(QDoubleVector2D(position), clipToViewPort);
-    else
+    } else
         return QGeoCoordinate();
 }
 
@@ -1557,9 +1731,14 @@ QGeoCoordinate QDeclarativeGeoMap::toCoordinate(const QPointF &position, bool cl
 */
 QPointF QDeclarativeGeoMap::fromCoordinate(const QGeoCoordinate &coordinate, bool clipToViewPort) const
 {
-    if (m_map)
+    if (m_map) {
+        if (hasPendingProjection()) {
+            QGeoProjectionWebMercator projection;
+            setupPendingProjection(projection);
+            return projection.coordinateToItemPosition(coordinate, clipToViewPort).toPointF();
+        }
         return m_map->geoProjection().coordinateToItemPosition(coordinate, clipToViewPort).toPointF();
-    else
+    } else
         return QPointF(qQNaN(), qQNaN());
 }
 
@@ -1581,6 +1760,7 @@ void QDeclarativeGeoMap::pan(int dx, int dy)
     if (dx == 0 && dy == 0)
         return;
 
+    flushPendingCameraData();
     QGeoCoordinate coord = m_map->geoProjection().itemPositionToCoordinate(
                                 QDoubleVector2D(m_map->viewportWidth() / 2 + dx,
                                         m_map->viewportHeight() / 2 + dy));
@@ -1600,6 +1780,333 @@ void QDeclarativeGeoMap::prefetchData()
     m_map->prefetchData();
 }
 
+/*!
+    Schedules the background loading of the tiles along a camera \a path, e.g. the predicted
+    cameras of a gesture or the key frames of a camera animation, and returns the identifier
+    of the request for cancelPrefetch().  The path starts from the current camera.
+
+    Requests are served by \a priority, then by \a deadline in milliseconds, and each path is
+    loaded in order, so that the tiles arrive in the order they will be needed.  A request
+    is dropped when its deadline expires, -1 means no deadline.
+
+    Only tiled maps support it, the request is ignored by the other maps and 0 is returned.
+*/
+int QDeclarativeGeoMap::prefetchCameraPath(const QList<QGeoCameraData> &path, int deadline,
+                                           PrefetchPriority priority)
+{
+    if (path.isEmpty() || !qobject_cast<QGeoTiledMap *>(m_map.data()))
+        return 0;
+
+    PrefetchRequest request;
+    request.id = ++m_lastPrefetchId;
+    request.path = path;
+    request.deadline = deadline < 0 ? QDeadlineTimer(QDeadlineTimer::Forever) : QDeadlineTimer(deadline);
+    request.priority = priority;
+
+    auto it = std::find_if(m_prefetchRequests.begin(), m_prefetchRequests.end(),
+                           [&request](const PrefetchRequest &other) {
+        return other.priority < request.priority
+                || (other.priority == request.priority && request.deadline < other.deadline);
+    });
+    m_prefetchRequests.insert(it, request);
+
+    restartPrefetch();
+    return request.id;
+}
+
+/*!
+    \qmlmethod int QtLocation::Map::prefetchCamera(coordinate center, real zoomLevel, real bearing, real tilt, int deadline, enumeration priority)
+
+    Schedules the background loading of the tiles from the current camera up to the camera
+    defined by \a center, \a zoomLevel, \a bearing and \a tilt, before it is animated to it.
+    Returns an identifier for cancelPrefetch(), or 0 if the map doesn't support it.
+
+    The \a deadline is in milliseconds, -1 means no deadline.
+    The \a priority is one of Map.LowPrefetchPriority, Map.NormalPrefetchPriority or
+    Map.HighPrefetchPriority.
+
+    \since 5.15
+*/
+int QDeclarativeGeoMap::prefetchCamera(const QGeoCoordinate &center, qreal zoomLevel,
+                                       qreal bearing, qreal tilt, int deadline,
+                                       PrefetchPriority priority)
+{
+    QGeoCameraData cameraData = currentCameraData();
+    cameraData.setCenter(center);
+    cameraData.setZoomLevel(zoomLevel);
+    cameraData.setBearing(sanitizeBearing(bearing));
+    cameraData.setTilt(tilt);
+    return prefetchCameraPath({cameraData}, deadline, priority);
+}
+
+/*!
+    \qmlmethod void QtLocation::Map::cancelPrefetch(int id)
+
+    Cancels the prefetch request \a id, e.g. when the gesture or the animation that scheduled
+    it is superseded.  The tiles which are not yet loaded and are not visible are not fetched.
+
+    \since 5.15
+*/
+void QDeclarativeGeoMap::cancelPrefetch(int id)
+{
+    auto it = std::find_if(m_prefetchRequests.begin(), m_prefetchRequests.end(),
+                           [id](const PrefetchRequest &request) { return request.id == id; });
+    if (it == m_prefetchRequests.end())
+        return;
+    m_prefetchRequests.erase(it);
+    restartPrefetch();
+}
+
+QSet<QGeoTileSpec> QDeclarativeGeoMap::cameraPathTiles(const QGeoCameraData &from, const QGeoCameraData &to)
+{
+    static const int maximumNumberOfSamples = 8;
+
+    // the path is sampled in viewports
+    if (width() <= 0 || height() <= 0)
+        return QSet<QGeoTileSpec>();
+
+    // the tiles must have the version of the engine, else they are not the ones of the map
+    QGeoTiledMap *tiledMap = qobject_cast<QGeoTiledMap *>(m_map.data());
+    if (!tiledMap || !tiledMap->requestManager())
+        return QSet<QGeoTileSpec>();
+
+    const QGeoMapType mapType = m_map->activeMapType();
+    const int tileSize = m_cameraCapabilities.tileSize();
+
+    QGeoCameraTiles cameraTiles;
+    cameraTiles.setScreenSize(QSize(width(), height()));
+    cameraTiles.setTileSize(tileSize);
+    cameraTiles.setPluginString(mapType.pluginName());
+    cameraTiles.setMapType(mapType);
+    cameraTiles.setMapVersion(tiledMap->requestManager()->tileVersion());
+
+    // Sample the path in Mercator space every viewport at most, measured at the larger zoom level
+    const QDoubleVector2D start = QWebMercator::coordToMercator(from.center());
+    const QDoubleVector2D end = QWebMercator::coordToMercator(to.center());
+    QDoubleVector2D delta = end - start;
+    if (delta.x() > 0.5) // shortest way across the antimeridian
+        delta.setX(delta.x() - 1.0);
+    else if (delta.x() < -0.5)
+        delta.setX(delta.x() + 1.0);
+    const double scale = std::pow(2.0, qMax(from.zoomLevel(), to.zoomLevel())) * tileSize;
+    const double viewports = qMax(qAbs(delta.x()) * scale / width(), qAbs(delta.y()) * scale / height());
+    const int numberOfSamples = qBound(1, int(std::ceil(viewports)), maximumNumberOfSamples);
+
+    QSet<QGeoTileSpec> tiles;
+    QGeoCameraData sampleCameraData = to;
+    for (int i = 1; i <= numberOfSamples; ++i) {
+        const double t = double(i) / numberOfSamples;
+        QDoubleVector2D position = start + delta * t;
+        position.setX(position.x() - std::floor(position.x()));
+        sampleCameraData.setCenter(QWebMercator::mercatorToCoord(position));
+        sampleCameraData.setZoomLevel(from.zoomLevel() + (to.zoomLevel() - from.zoomLevel()) * t);
+        cameraTiles.setCameraData(sampleCameraData);
+        tiles += cameraTiles.createTiles();
+    }
+    return tiles;
+}
+
+void QDeclarativeGeoMap::restartPrefetch()
+{
+    m_prefetchedTiles.clear();
+    m_prefetchRequestIndex = 0;
+    m_prefetchSampleIndex = 0;
+    if (m_prefetchRequests.isEmpty()) {
+        // the tiles which are no longer requested are cancelled
+        requestPrefetchedTiles();
+        m_prefetchTimer.stop();
+    } else {
+        // the tiles of the first segment keep their place in the fetcher queue,
+        // the others are cancelled when it is scheduled
+        m_prefetchTimer.start(0);
+    }
+}
+
+void QDeclarativeGeoMap::requestPrefetchedTiles()
+{
+    QGeoTiledMap *tiledMap = qobject_cast<QGeoTiledMap *>(m_map.data());
+    if (!tiledMap || !tiledMap->requestManager())
+        return;
+
+    // the request manager keeps them along the visible tiles requested by the map
+    tiledMap->requestManager()->setPrefetchTiles(m_prefetchedTiles);
+}
+
+/*!
+    \internal
+
+    Schedules one path segment per event loop iteration, so that the tile fetcher queues the
+    tiles in order, then waits for the next deadline.
+*/
+void QDeclarativeGeoMap::schedulePrefetch()
+{
+    const auto expired = std::remove_if(m_prefetchRequests.begin(), m_prefetchRequests.end(),
+                                        [](const PrefetchRequest &request) { return request.deadline.hasExpired(); });
+    if (expired != m_prefetchRequests.end()) {
+        m_prefetchRequests.erase(expired, m_prefetchRequests.end());
+        restartPrefetch();
+        return;
+    }
+
+    if (m_prefetchRequestIndex < m_prefetchRequests.size()) {
+        const PrefetchRequest &request = m_prefetchRequests.at(m_prefetchRequestIndex);
+        const QGeoCameraData from = m_prefetchSampleIndex ? request.path.at(m_prefetchSampleIndex - 1)
+                                                          : currentCameraData();
+        m_prefetchedTiles += cameraPathTiles(from, request.path.at(m_prefetchSampleIndex));
+        requestPrefetchedTiles();
+        if (++m_prefetchSampleIndex == request.path.size()) {
+            m_prefetchSampleIndex = 0;
+            ++m_prefetchRequestIndex;
+        }
+        m_prefetchTimer.start(0);
+        return;
+    }
+
+    // everything is scheduled, wake up at the next deadline to drop the request
+    QDeadlineTimer next(QDeadlineTimer::Forever);
+    for (const PrefetchRequest &request : qAsConst(m_prefetchRequests))
+        next = qMin(next, request.deadline);
+    if (next.isForever())
+        m_prefetchTimer.stop();
+    else
+        m_prefetchTimer.start(qMax<qint64>(next.remainingTime(), 0));
+}
+
+/*!
+    \internal
+
+    Enables the measurement of the input-to-photon latency of the gestures: the time from the
+    timestamp of an input event to the swap of the frame which contains the camera change it
+    caused, see tagCameraUpdate().  Event timestamps are expected from the monotonic clock.
+*/
+void QDeclarativeGeoMap::setInputLatencyTracking(bool enabled)
+{
+    if (m_inputLatencyTracking == enabled)
+        return;
+
+    m_inputLatencyTracking = enabled;
+    if (!enabled)
+        m_pendingInputTimestamps.clear();
+    emit inputLatencyTrackingChanged(enabled);
+}
+
+bool QDeclarativeGeoMap::inputLatencyTracking() const
+{
+    return m_inputLatencyTracking;
+}
+
+/*!
+    \internal
+
+    Tags the camera change with the timestamp of the input event that caused it, in milliseconds.
+*/
+void QDeclarativeGeoMap::tagCameraUpdate(quint64 inputTimestamp)
+{
+    if (!m_inputLatencyTracking || !inputTimestamp)
+        return;
+    // inputs coalesced in a frame are all measured, up to the capacity, without allocation
+    if (m_pendingInputTimestamps.size() < m_pendingInputTimestamps.capacity())
+        m_pendingInputTimestamps.append(inputTimestamp);
+}
+
+/*!
+    \internal
+
+    Returns whether \a latency, in milliseconds, is plausible: a negative latency or one longer
+    than ten seconds means that the event timestamp is not from the monotonic clock.  The gesture
+    statistics apply the same check.
+*/
+bool QDeclarativeGeoMap::isValidInputLatency(qint64 latency)
+{
+    return latency >= 0 && latency <= maximumInputLatency;
+}
+
+// Called on the render thread while the GUI thread is blocked, the frame contains the pending changes
+void QDeclarativeGeoMap::synchronizeInputLatency()
+{
+    if (m_pendingInputTimestamps.isEmpty())
+        return;
+    m_frameInputTimestamps.append(m_pendingInputTimestamps.constData(), m_pendingInputTimestamps.size());
+    m_pendingInputTimestamps.clear();
+}
+
+// Called on the render thread
+void QDeclarativeGeoMap::recordInputLatency()
+{
+    if (m_frameInputTimestamps.isEmpty())
+        return;
+    const qint64 now = QElapsedTimer::msecsSinceReference();
+    QMutexLocker locker(&m_inputLatencyMutex);
+    for (quint64 inputTimestamp : qAsConst(m_frameInputTimestamps)) {
+        const qint64 latency = now - qint64(inputTimestamp);
+        if (!isValidInputLatency(latency))
+            continue;
+        m_inputLatencyHistogram[qMin<qint64>(latency, inputLatencyHistogramSize - 1)]++;
+        m_inputLatencySamples++;
+    }
+    m_frameInputTimestamps.clear();
+}
+
+/*!
+    \internal
+
+    Returns the number of samples and the p50, p95, p99 and maximum input-to-photon latencies
+    in milliseconds, the last bin of the histogram collects the larger latencies.
+*/
+QVariantMap QDeclarativeGeoMap::inputLatency() const
+{
+    QMutexLocker locker(&m_inputLatencyMutex);
+
+    QVariantMap latency;
+    latency.insert(QStringLiteral("samples"), m_inputLatencySamples);
+
+    const quint64 ranks[] = {
+        (m_inputLatencySamples * 50 + 99) / 100,
+        (m_inputLatencySamples * 95 + 99) / 100,
+        (m_inputLatencySamples * 99 + 99) / 100,
+        m_inputLatencySamples
+    };
+    const QString names[] = {
+        QStringLiteral("p50"), QStringLiteral("p95"), QStringLiteral("p99"), QStringLiteral("max")
+    };
+    int rank = 0;
+    quint64 count = 0;
+    for (int bin = 0; bin < inputLatencyHistogramSize && rank < 4; ++bin) {
+        count += m_inputLatencyHistogram[bin];
+        while (rank < 4 && ranks[rank] && count >= ranks[rank])
+            latency.insert(names[rank++], bin);
+    }
+    return latency;
+}
+
+/*!
+    \internal
+
+    Writes the input-to-photon latency histogram to \a fileName as CSV, one line per
+    millisecond bin.
+*/
+bool QDeclarativeGeoMap::dumpInputLatency(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
+        return false;
+
+    QMutexLocker locker(&m_inputLatencyMutex);
+    QTextStream stream(&file);
+    stream << "latency_ms,count\n";
+    for (int bin = 0; bin < inputLatencyHistogramSize; ++bin)
+        stream << bin << ',' << m_inputLatencyHistogram[bin] << '\n';
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+void QDeclarativeGeoMap::resetInputLatency()
+{
+    QMutexLocker locker(&m_inputLatencyMutex);
+    m_inputLatencyHistogram.fill(0);
+    m_inputLatencySamples = 0;
+}
+
 /*!
     \qmlmethod void QtLocation::Map::clearData()
 
@@ -1647,6 +2154,7 @@ void QDeclarativeGeoMap::fitViewportToGeoShape(const QGeoShape &shape, const QMa
     if (!m_map  || !shape.isValid())
         return;
 
+    flushPendingCameraData();
     if (m_map->geoProjection().projectionType() == QGeoProjection::ProjectionWebMercator) {
         // This case remains handled here, and not inside QGeoMap*::fitViewportToGeoRectangle,
         // in order to honor animations on center and zoomLevel
@@ -1768,6 +2276,13 @@ void QDeclarativeGeoMap::onAttachedCopyrightNoticeVisibilityChanged()
 
 void QDeclarativeGeoMap::onCameraDataChanged(const QGeoCameraData &cameraData)
 {
+    // notifications are sent once by commitCameraUpdate(), the map can also be changed
+    // directly within a transaction, e.g. by anchorCoordinateToPoint()
+    if (m_cameraUpdateDepth > 0) {
+        m_cameraChanged = true;
+        return;
+    }
+
     bool centerHasChanged = cameraData.center() != m_cameraData.center();
     bool bearingHasChanged = cameraData.bearing() != m_cameraData.bearing();
     bool tiltHasChanged = cameraData.tilt() != m_cameraData.tilt();
@@ -1775,11 +2290,9 @@ void QDeclarativeGeoMap::onCameraDataChanged(const QGeoCameraData &cameraData)
     bool zoomHasChanged = cameraData.zoomLevel() != m_cameraData.zoomLevel();
 
     m_cameraData = cameraData;
-    // polish map items
-    for (const QPointer<QDeclarativeGeoMapItemBase> &i: qAsConst(m_mapItems)) {
-        if (i)
-            i->baseCameraDataChanged(m_cameraData); // Consider optimizing this further, removing the contained duplicate if conditions.
-    }
+    // the map items are updated at polish time, only those in view, see syncMapItemsToCamera()
+    ++m_cameraGeneration;
+    polish();
 
     if (centerHasChanged)
         emit centerChanged(m_cameraData.center());
@@ -1796,6 +2309,151 @@ void QDeclarativeGeoMap::onCameraDataChanged(const QGeoCameraData &cameraData)
         emit visibleRegionChanged();
 }
 
+/*!
+    \internal
+*/
+void QDeclarativeGeoMap::updatePolish()
+{
+    QQuickItem::updatePolish();
+    syncMapItemsToCamera(true);
+}
+
+/*!
+    \internal
+    Notify the map items of the camera changes since their last update.
+
+    Each camera change increments a generation counter, an item is updated when its generation
+    is behind.  If \a onlyInView is true, only the items whose bounds intersect the visible
+    region, expanded by half its size on each side, are updated, they are selected with the
+    spatial index.
+
+    The items which were in the region at the previous update and have left it, e.g. after a
+    jump of the camera, are updated once more so that they are moved off screen.  Thus an item
+    out of the region was last updated with a camera for which it was off screen, and it
+    catches up when it comes into view, baseCameraDataChanged() compares the camera with the
+    last one seen by the item.
+*/
+void QDeclarativeGeoMap::syncMapItemsToCamera(bool onlyInView)
+{
+    updateMapItemBounds();
+
+    QGeoRectangle region;
+    if (onlyInView) {
+        region = visibleRegion().boundingGeoRectangle();
+        if (region.isValid() && region.width() < 180.0) {
+            region.setWidth(region.width() * 2.0);
+            region.setHeight(qMin(region.height() * 2.0, 180.0));
+        } else {
+            region = QGeoRectangle(); // the whole world is in view, e.g. the horizon is visible
+        }
+    }
+
+    const auto syncItem = [this](QDeclarativeGeoMapItemBase *item) {
+        const auto slot = m_mapItemSlots.find(item);
+        if (slot == m_mapItemSlots.end() || slot->cameraGeneration == m_cameraGeneration)
+            return;
+        item->baseCameraDataChanged(m_cameraData);
+        slot->cameraGeneration = m_cameraGeneration;
+    };
+
+    if (!region.isValid()) {
+        for (const QPointer<QDeclarativeGeoMapItemBase> &item : qAsConst(m_mapItems)) {
+            if (item)
+                syncItem(item.data());
+        }
+        m_mapItemsInRegion.clear();
+        m_allMapItemsInRegion = true;
+        return;
+    }
+
+    const auto items = m_mapItemIndex.query(region);
+    QSet<QDeclarativeGeoMapItemBase *> itemsInRegion;
+    itemsInRegion.reserve(items.size());
+    for (QDeclarativeGeoMapItemBase *item : items) {
+        syncItem(item);
+        itemsInRegion.insert(item);
+    }
+
+    // the items which left the region are moved off screen
+    if (m_allMapItemsInRegion) {
+        for (const QPointer<QDeclarativeGeoMapItemBase> &item : qAsConst(m_mapItems)) {
+            if (item && !itemsInRegion.contains(item.data()))
+                syncItem(item.data());
+        }
+    } else {
+        for (QDeclarativeGeoMapItemBase *item : qAsConst(m_mapItemsInRegion)) {
+            if (!itemsInRegion.contains(item))
+                syncItem(item);
+        }
+    }
+    m_mapItemsInRegion.swap(itemsInRegion);
+    m_allMapItemsInRegion = false;
+}
+
+/*!
+    \internal
+    Update the bounds of the items that moved in the spatial index.
+*/
+void QDeclarativeGeoMap::updateMapItemBounds()
+{
+    for (QDeclarativeGeoMapItemBase *item : qAsConst(m_mapItemsWithDirtyBounds))
+        m_mapItemIndex.update(item, item->geoShape().boundingGeoRectangle());
+    m_mapItemsWithDirtyBounds.clear();
+}
+
+static QMetaMethod mapItemGeoShapeChangedSlot()
+{
+    static const QMetaMethod slot = QDeclarativeGeoMap::staticMetaObject.method(
+                QDeclarativeGeoMap::staticMetaObject.indexOfSlot("onMapItemGeoShapeChanged()"));
+    return slot;
+}
+
+/*!
+    \internal
+    Watch the properties declared by the type of \a item, e.g. the center of a MapCircle or the
+    path of a MapPolyline, its geographic shape can only change with them.  The screen geometry
+    of the item is not watched, it changes at each camera update while the bounds don't.
+*/
+void QDeclarativeGeoMap::connectMapItemGeoShape(QDeclarativeGeoMapItemBase *item)
+{
+    const QMetaObject *metaObject = item->metaObject();
+    for (int i = QDeclarativeGeoMapItemBase::staticMetaObject.propertyCount(); i < metaObject->propertyCount(); ++i) {
+        const QMetaProperty property = metaObject->property(i);
+        if (property.hasNotifySignal())
+            connect(item, property.notifySignal(), this, mapItemGeoShapeChangedSlot(), Qt::UniqueConnection);
+    }
+}
+
+void QDeclarativeGeoMap::disconnectMapItemGeoShape(QDeclarativeGeoMapItemBase *item)
+{
+    disconnect(item, QMetaMethod(), this, mapItemGeoShapeChangedSlot());
+}
+
+/*!
+    \internal
+    The geographic bounds of the item are read at the next polish.
+*/
+void QDeclarativeGeoMap::onMapItemGeoShapeChanged()
+{
+    QDeclarativeGeoMapItemBase *item = static_cast<QDeclarativeGeoMapItemBase *>(sender());
+    if (m_mapItemSlots.contains(item))
+        m_mapItemsWithDirtyBounds.insert(item);
+}
+
+/*!
+    \internal
+*/
+void QDeclarativeGeoMap::itemDestroyed(QQuickItem *item)
+{
+    QDeclarativeGeoMapItemBase *mapItem = static_cast<QDeclarativeGeoMapItemBase *>(item);
+    const auto slot = m_mapItemSlots.constFind(mapItem);
+    if (slot != m_mapItemSlots.constEnd())
+        takeMapItemAt(slot->index);
+    m_mapItemIndex.remove(mapItem);
+    m_mapItemsWithDirtyBounds.remove(mapItem);
+    m_mapItemsInRegion.remove(mapItem);
+}
+
 /*!
     \qmlmethod void QtLocation::Map::addMapParameter(MapParameter parameter)
 
@@ -1967,12 +2625,17 @@ QList<QGeoMapObject *> QDeclarativeGeoMap::mapObjects()
 
 QList<QObject *> QDeclarativeGeoMap::mapItems()
 {
-    QList<QObject *> ret;
-    foreach (const QPointer<QDeclarativeGeoMapItemBase> &ptr, m_mapItems) {
-        if (ptr)
-            ret << ptr.data();
+    // the list is built once per change, the bindings get a shared copy
+    if (!m_mapItemsCacheValid) {
+        m_mapItemsCache.clear();
+        m_mapItemsCache.reserve(m_mapItemSlots.size());
+        for (const QPointer<QDeclarativeGeoMapItemBase> &ptr : qAsConst(m_mapItems)) {
+            if (ptr)
+                m_mapItemsCache.append(ptr.data());
+        }
+        m_mapItemsCacheValid = true;
     }
-    return ret;
+    return m_mapItemsCache;
 }
 
 /*!
@@ -2001,12 +2664,62 @@ void QDeclarativeGeoMap::addMapItem(QDeclarativeGeoMapItemBase *item)
 
 bool QDeclarativeGeoMap::addMapItem_real(QDeclarativeGeoMapItemBase *item)
 {
-    if (!item || item->quickMap())
+    if (!attachMapItem(item))
+        return false;
+    m_mapItemIndex.insert(item, item->geoShape().boundingGeoRectangle());
+    return true;
+}
+
+/*!
+    \qmlmethod void QtLocation::Map::addMapItems(list<MapItem> items)
+
+    Adds the given \a items to the Map. This is equivalent to calling \l addMapItem for
+    each item, but \l mapItems changes only once, which is much faster for large layers.
+    Items that are already on the Map are skipped.
+
+    \sa addMapItem, removeMapItems
+*/
+void QDeclarativeGeoMap::addMapItems(const QVariantList &items)
+{
+    QList<QPair<QGeoMapItemSpatialIndex::Item, QGeoRectangle> > added;
+    added.reserve(items.size());
+    m_mapItems.reserve(m_mapItems.size() + items.size());
+    m_mapItemSlots.reserve(m_mapItemSlots.size() + items.size());
+    for (const QVariant &i : items) {
+        QDeclarativeGeoMapItemBase *item = qobject_cast<QDeclarativeGeoMapItemBase *>(i.value<QObject *>());
+        if (attachMapItem(item))
+            added.append(qMakePair(item, item->geoShape().boundingGeoRectangle()));
+    }
+    if (added.isEmpty())
+        return;
+
+    // a large batch rebuilds the spatial index in one go
+    m_mapItemIndex.insert(added);
+    emit mapItemsChanged();
+}
+
+/*!
+    \internal
+    Register the item, except in the spatial index.  Returns false if the item is null or
+    already on a map.
+*/
+bool QDeclarativeGeoMap::attachMapItem(QDeclarativeGeoMapItemBase *item)
+{
+    if (!item || item->quickMap() || m_mapItemSlots.contains(item))
         return false;
     // If the item comes from a MapItemGroup, do not reparent it.
     if (!qobject_cast<QDeclarativeGeoMapItemGroup *>(item->parentItem()))
         item->setParentItem(this);
+    m_mapItemSlots.insert(item, MapItemSlot{int(m_mapItems.size()), m_cameraGeneration});
     m_mapItems.append(item);
+    m_mapItemsCacheValid = false;
+    // the item is in sync with the current camera, it must leave the region like the others
+    if (!m_allMapItemsInRegion)
+        m_mapItemsInRegion.insert(item);
+    // the bounds may depend on the map, they are read again at the next polish
+    m_mapItemsWithDirtyBounds.insert(item);
+    QQuickItemPrivate::get(item)->addItemChangeListener(this, QQuickItemPrivate::Destroyed);
+    connectMapItemGeoShape(item);
     if (m_map) {
         item->setMap(this, m_map);
         m_map->addMapItem(item);
@@ -2033,17 +2746,84 @@ bool QDeclarativeGeoMap::removeMapItem_real(QDeclarativeGeoMapItemBase *ptr)
 {
     if (!ptr)
         return false;
-    QPointer<QDeclarativeGeoMapItemBase> item(ptr);
-    if (!m_mapItems.contains(item))
+    const auto slot = m_mapItemSlots.constFind(ptr);
+    if (slot == m_mapItemSlots.constEnd())
         return false;
+    takeMapItemAt(slot->index);
+    m_mapItemIndex.remove(ptr);
+    m_mapItemsWithDirtyBounds.remove(ptr);
+    m_mapItemsInRegion.remove(ptr);
+    detachMapItem(ptr);
+    return true;
+}
+
+/*!
+    \qmlmethod void QtLocation::Map::removeMapItems(list<MapItem> items)
+
+    Removes the given \a items from the Map. This is equivalent to calling \l removeMapItem
+    for each item, but \l mapItems changes only once.
+
+    \sa removeMapItem, addMapItems, clearMapItems
+*/
+void QDeclarativeGeoMap::removeMapItems(const QVariantList &items)
+{
+    int removed = 0;
+    for (const QVariant &i : items)
+        removed += removeMapItem_real(qobject_cast<QDeclarativeGeoMapItemBase *>(i.value<QObject *>()));
+    if (removed)
+        emit mapItemsChanged();
+}
+
+/*!
+    \internal
+    Remove the item at \a index from m_mapItems in constant time, its entry is cleared and left
+    as a tombstone so that the other items keep their order.  The list is compacted when the
+    tombstones outnumber the items, which is amortized constant time.  The loops over m_mapItems
+    skip the null entries.
+*/
+void QDeclarativeGeoMap::takeMapItemAt(int index)
+{
+    QDeclarativeGeoMapItemBase *item = m_mapItems.at(index).data();
+    m_mapItems[index].clear();
+    m_mapItemSlots.remove(item);
+    m_mapItemsCacheValid = false;
+    if (++m_mapItemTombstones > m_mapItemSlots.size())
+        compactMapItems();
+}
+
+/*!
+    \internal
+    Drop the tombstones of m_mapItems and renumber the slots of the items.
+*/
+void QDeclarativeGeoMap::compactMapItems()
+{
+    int count = 0;
+    for (int i = 0; i < m_mapItems.size(); ++i) {
+        const auto slot = m_mapItemSlots.find(m_mapItems.at(i).data());
+        if (!m_mapItems.at(i) || slot == m_mapItemSlots.end())
+            continue;
+        slot->index = count;
+        if (i != count)
+            m_mapItems[count] = m_mapItems.at(i);
+        ++count;
+    }
+    m_mapItems.erase(m_mapItems.begin() + count, m_mapItems.end());
+    m_mapItemTombstones = 0;
+}
+
+/*!
+    \internal
+    Undo what addMapItem_real did to the item, except for the bookkeeping of the map.
+*/
+void QDeclarativeGeoMap::detachMapItem(QDeclarativeGeoMapItemBase *item)
+{
+    QQuickItemPrivate::get(item)->removeItemChangeListener(this, QQuickItemPrivate::Destroyed);
+    disconnectMapItemGeoShape(item);
     if (m_map)
-        m_map->removeMapItem(ptr);
+        m_map->removeMapItem(item);
     if (item->parentItem() == this)
         item->setParentItem(0);
     item->setMap(0, 0);
-    // these can be optimized for perf, as we already check the 'contains' above
-    m_mapItems.removeOne(item);
-    return true;
 }
 
 /*!
@@ -2055,7 +2835,7 @@ bool QDeclarativeGeoMap::removeMapItem_real(QDeclarativeGeoMapItemBase *ptr)
 */
 void QDeclarativeGeoMap::clearMapItems()
 {
-    if (m_mapItems.isEmpty())
+    if (m_mapItemSlots.isEmpty())
         return;
 
     int removed = 0;
@@ -2075,8 +2855,20 @@ void QDeclarativeGeoMap::clearMapItems()
         }
     }
 
-    while (!m_mapItems.isEmpty())
-        removed += removeMapItem_real(m_mapItems.first());
+    // take the items out first, so that detaching an item cannot see a partial state
+    const auto mapItems = std::exchange(m_mapItems, {});
+    m_mapItemsCacheValid = false;
+    m_mapItemTombstones = 0;
+    m_mapItemSlots.clear();
+    m_mapItemIndex.clear();
+    m_mapItemsWithDirtyBounds.clear();
+    m_mapItemsInRegion.clear();
+    for (const QPointer<QDeclarativeGeoMapItemBase> &item : mapItems) {
+        if (item) {
+            detachMapItem(item.data());
+            ++removed;
+        }
+    }
 
     if (removed)
         emit mapItemsChanged();
@@ -2199,8 +2991,10 @@ void QDeclarativeGeoMap::updateItemToWindowTransform()
     // the item or one of its ancestors changed), a forced update of the map items using accelerated
     // GL implementation has to be performed in order to have them pulling the updated itemToWindowTransform.
     if (!m_sgNodeHasChanged && item2WindowOld != item2Window) {
-        for (auto i: qAsConst(m_mapItems))
-            i->setMaterialDirty();
+        for (auto i: qAsConst(m_mapItems)) {
+            if (i)
+                i->setMaterialDirty();
+        }
     }
 
     m_sgNodeHasChanged = false;
@@ -2288,6 +3082,7 @@ void QDeclarativeGeoMap::geometryChanged(const QRectF &newGeometry, const QRectF
         initialize();
     } else {
         setMinimumZoomLevel(m_map->minimumZoom(), false);
+        flushPendingCameraData();
 
         // Update the center latitudinal threshold
         QGeoCameraData cameraData = m_map->cameraData();
@@ -2380,6 +3175,9 @@ void QDeclarativeGeoMap::fitViewportToMapItemsRefine(const QList<QPointer<QDecla
     if (mapItems.size() == 0)
         return;
 
+    // the bounds of the items depend on the camera, the items out of view may be behind
+    syncMapItemsToCamera(false);
+
     double minX = qInf();
     double maxX = -qInf();
     double minY = qInf();
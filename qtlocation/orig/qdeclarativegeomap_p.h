@@ -56,12 +56,21 @@
 #include <QtLocation/private/qgeocameradata_p.h>
 #include <QtLocation/private/qgeocameracapabilities_p.h>
 #include <QtQuick/QQuickItem>
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QPointer>
+#include <QtCore/QDeadlineTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
 #include <QtGui/QColor>
 #include <QtPositioning/qgeorectangle.h>
 #include <QtLocation/private/qgeomap_p.h>
+#include <QtLocation/private/qgeotilespec_p.h>
+#include <QtLocation/private/qgeomapitemspatialindex_p.h>
 #include <QtQuick/private/qquickitemchangelistener_p.h>
+#include <array>
 
 Q_MOC_INCLUDE(<QtLocation/private/qdeclarativegeomaptype_p.h>)
 Q_MOC_INCLUDE(<QtLocation/private/qdeclarativegeoserviceprovider_p.h>)
@@ -72,8 +81,9 @@ class QDeclarativeGeoServiceProvider;
 class QDeclarativeGeoMapType;
 class QDeclarativeGeoMapCopyrightNotice;
 class QDeclarativeGeoMapParameter;
+class QGeoProjectionWebMercator;
 
-class Q_LOCATION_PRIVATE_EXPORT QDeclarativeGeoMap : public QQuickItem
+class Q_LOCATION_PRIVATE_EXPORT QDeclarativeGeoMap : public QQuickItem, public QQuickItemChangeListener
 {
     Q_OBJECT
     Q_ENUMS(QGeoServiceProvider::Error)
@@ -105,9 +115,16 @@ class Q_LOCATION_PRIVATE_EXPORT QDeclarativeGeoMap : public QQuickItem
     Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
     Q_PROPERTY(bool mapReady READ mapReady NOTIFY mapReadyChanged)
     Q_PROPERTY(QRectF visibleArea READ visibleArea WRITE setVisibleArea NOTIFY visibleAreaChanged  REVISION 12)
+    Q_PROPERTY(bool inputLatencyTracking READ inputLatencyTracking WRITE setInputLatencyTracking NOTIFY inputLatencyTrackingChanged REVISION 15)
     Q_INTERFACES(QQmlParserStatus)
 
 public:
+    enum PrefetchPriority {
+        LowPrefetchPriority,
+        NormalPrefetchPriority,
+        HighPrefetchPriority
+    };
+    Q_ENUM(PrefetchPriority)
 
     explicit QDeclarativeGeoMap(QQuickItem *parent = 0);
     ~QDeclarativeGeoMap();
@@ -168,8 +185,14 @@ public:
     Q_INVOKABLE void setBearing(qreal bearing, const QGeoCoordinate &coordinate);
     Q_INVOKABLE void alignCoordinateToPoint(const QGeoCoordinate &coordinate, const QPointF &point);
 
+    void beginCameraUpdate();
+    bool commitCameraUpdate();
+    bool isCameraUpdateInProgress() const;
+
     Q_INVOKABLE void removeMapItem(QDeclarativeGeoMapItemBase *item);
     Q_INVOKABLE void addMapItem(QDeclarativeGeoMapItemBase *item);
+    Q_INVOKABLE void addMapItems(const QVariantList &items);
+    Q_INVOKABLE void removeMapItems(const QVariantList &items);
 
     Q_INVOKABLE void addMapItemGroup(QDeclarativeGeoMapItemGroup *itemGroup);
     Q_INVOKABLE void removeMapItemGroup(QDeclarativeGeoMapItemGroup *itemGroup);
@@ -200,6 +223,20 @@ public:
     Q_INVOKABLE void fitViewportToVisibleMapItems();
     Q_INVOKABLE void pan(int dx, int dy);
     Q_INVOKABLE void prefetchData(); // optional hint for prefetch
+    int prefetchCameraPath(const QList<QGeoCameraData> &path, int deadline = -1,
+                           PrefetchPriority priority = NormalPrefetchPriority);
+    Q_REVISION(15) Q_INVOKABLE int prefetchCamera(const QGeoCoordinate &center, qreal zoomLevel,
+                                                  qreal bearing = 0.0, qreal tilt = 0.0, int deadline = -1,
+                                                  PrefetchPriority priority = NormalPrefetchPriority);
+    Q_REVISION(15) Q_INVOKABLE void cancelPrefetch(int id);
+
+    void setInputLatencyTracking(bool enabled);
+    bool inputLatencyTracking() const;
+    void tagCameraUpdate(quint64 inputTimestamp); // the camera was changed by this input event
+    static bool isValidInputLatency(qint64 latency);
+    Q_REVISION(15) Q_INVOKABLE QVariantMap inputLatency() const;
+    Q_REVISION(15) Q_INVOKABLE bool dumpInputLatency(const QString &fileName) const;
+    Q_REVISION(15) Q_INVOKABLE void resetInputLatency();
     Q_INVOKABLE void clearData();
     Q_REVISION(13) Q_INVOKABLE void fitViewportToGeoShape(const QGeoShape &shape, QVariant margins);
     void fitViewportToGeoShape(const QGeoShape &shape, const QMargins &borders = QMargins(10, 10, 10, 10));
@@ -211,6 +248,9 @@ public:
     // From QQuickItem
     void itemChange(ItemChange, const ItemChangeData &) override;
 
+    // From QQuickItemChangeListener, for the map items
+    void itemDestroyed(QQuickItem *item) override;
+
 Q_SIGNALS:
     void pluginChanged(QDeclarativeGeoServiceProvider *plugin);
     void zoomLevelChanged(qreal zoomLevel);
@@ -237,6 +277,7 @@ Q_SIGNALS:
     Q_REVISION(11) void mapObjectsChanged();
     void visibleAreaChanged();
     Q_REVISION(14) void visibleRegionChanged();
+    Q_REVISION(15) void inputLatencyTrackingChanged(bool enabled);
 
 protected:
     void mousePressEvent(QMouseEvent *event) override ;
@@ -256,6 +297,7 @@ protected:
     void componentComplete() override;
     QSGNode *updatePaintNode(QSGNode *, UpdatePaintNodeData *) override;
     void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+    void updatePolish() override;
 
     void setError(QGeoServiceProvider::Error error, const QString &errorString);
     void initialize();
@@ -266,6 +308,10 @@ protected:
 
     bool addMapItem_real(QDeclarativeGeoMapItemBase *item);
     bool removeMapItem_real(QDeclarativeGeoMapItemBase *item);
+    bool attachMapItem(QDeclarativeGeoMapItemBase *item);
+    void detachMapItem(QDeclarativeGeoMapItemBase *item);
+    void takeMapItemAt(int index);
+    void compactMapItems();
     bool addMapItemGroup_real(QDeclarativeGeoMapItemGroup *itemGroup);
     bool removeMapItemGroup_real(QDeclarativeGeoMapItemGroup *itemGroup);
     bool addMapItemView_real(QDeclarativeGeoMapItemView *itemView);
@@ -280,6 +326,10 @@ private Q_SLOTS:
     void onCameraCapabilitiesChanged(const QGeoCameraCapabilities &oldCameraCapabilities);
     void onAttachedCopyrightNoticeVisibilityChanged();
     void onCameraDataChanged(const QGeoCameraData &cameraData);
+    void schedulePrefetch();
+    void synchronizeInputLatency();
+    void recordInputLatency();
+    void onMapItemGeoShapeChanged();
 
 private:
     void setupMapView(QDeclarativeGeoMapItemView *view);
@@ -290,6 +340,18 @@ private:
     void attachCopyrightNotice(bool initialVisibility);
     void detachCopyrightNotice(bool currentVisibility);
     QMargins mapMargins() const;
+    QGeoCameraData currentCameraData() const;
+    void setMapCameraData(const QGeoCameraData &cameraData);
+    bool hasPendingProjection() const;
+    void setupPendingProjection(QGeoProjectionWebMercator &projection) const;
+    void flushPendingCameraData();
+    QSet<QGeoTileSpec> cameraPathTiles(const QGeoCameraData &from, const QGeoCameraData &to);
+    void restartPrefetch();
+    void requestPrefetchedTiles();
+    void syncMapItemsToCamera(bool onlyInView);
+    void updateMapItemBounds();
+    void connectMapItemGeoShape(QDeclarativeGeoMapItemBase *item);
+    void disconnectMapItemGeoShape(QDeclarativeGeoMapItemBase *item);
 
 private:
     QDeclarativeGeoServiceProvider *m_plugin;
@@ -334,6 +396,52 @@ private:
     qreal m_maxChildZ = 0;
     QRectF m_visibleArea;
 
+    // camera transaction, see beginCameraUpdate()
+    int m_cameraUpdateDepth = 0;
+    bool m_cameraDataPending = false;
+    bool m_cameraChanged = false; // the camera was changed within the transaction
+    QGeoCameraData m_pendingCameraData;
+
+    // the map items are updated lazily to the camera, see syncMapItemsToCamera()
+    quint64 m_cameraGeneration = 0;
+    struct MapItemSlot
+    {
+        int index; // in m_mapItems
+        quint64 cameraGeneration;
+    };
+    QHash<QDeclarativeGeoMapItemBase *, MapItemSlot> m_mapItemSlots; // one per item of m_mapItems
+    int m_mapItemTombstones = 0; // null entries of m_mapItems, see takeMapItemAt()
+    QList<QObject *> m_mapItemsCache; // returned by mapItems(), see m_mapItemsCacheValid
+    bool m_mapItemsCacheValid = false;
+    QGeoMapItemSpatialIndex m_mapItemIndex; // geographic bounds of the items
+    QSet<QDeclarativeGeoMapItemBase *> m_mapItemsWithDirtyBounds; // bounds to update in the index
+    QSet<QDeclarativeGeoMapItemBase *> m_mapItemsInRegion; // updated by the last syncMapItemsToCamera()
+    bool m_allMapItemsInRegion = true; // the last region was the whole world
+
+    // prefetch requests, see prefetchCameraPath()
+    struct PrefetchRequest
+    {
+        int id;
+        QList<QGeoCameraData> path;
+        QDeadlineTimer deadline;
+        PrefetchPriority priority;
+    };
+    QList<PrefetchRequest> m_prefetchRequests; // by priority, then by deadline
+    QSet<QGeoTileSpec> m_prefetchedTiles; // tiles handed to the request manager
+    int m_prefetchRequestIndex = 0; // next path segment to schedule
+    int m_prefetchSampleIndex = 0;
+    int m_lastPrefetchId = 0;
+    QTimer m_prefetchTimer;
+
+    // input-to-photon latency, see setInputLatencyTracking()
+    static constexpr int inputLatencyHistogramSize = 256; // 1 ms bins, the last one collects the overflow
+    static constexpr qint64 maximumInputLatency = 10 * 1000; // larger latencies are clock mismatches
+    bool m_inputLatencyTracking = false;
+    QVarLengthArray<quint64, 16> m_pendingInputTimestamps; // GUI thread
+    QVarLengthArray<quint64, 16> m_frameInputTimestamps; // render thread, from the synchronization
+    mutable QMutex m_inputLatencyMutex; // for the histogram
+    std::array<quint32, inputLatencyHistogramSize> m_inputLatencyHistogram = {};
+    quint64 m_inputLatencySamples = 0;
 
     friend class QDeclarativeGeoMapItem;
     friend class QDeclarativeGeoMapItemView;
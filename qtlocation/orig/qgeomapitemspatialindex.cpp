@@ -0,0 +1,420 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtLocation module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qgeomapitemspatialindex_p.h"
+#include <algorithm>
+#include <cmath>
+
+QT_BEGIN_NAMESPACE
+
+QGeoMapItemSpatialIndex::Box QGeoMapItemSpatialIndex::Box::fromRectangle(const QGeoRectangle &rectangle)
+{
+    Box box;
+    if (!rectangle.isValid())
+        return box;
+    box.left = rectangle.topLeft().longitude();
+    box.right = rectangle.bottomRight().longitude();
+    if (box.right < box.left) // crossing the dateline
+        box.right += 360.0;
+    box.bottom = rectangle.bottomRight().latitude();
+    box.top = rectangle.topLeft().latitude();
+    box.valid = true;
+    return box;
+}
+
+bool QGeoMapItemSpatialIndex::Box::operator==(const Box &other) const
+{
+    return valid == other.valid && left == other.left && bottom == other.bottom
+            && right == other.right && top == other.top;
+}
+
+bool QGeoMapItemSpatialIndex::Box::intersects(const Box &other) const
+{
+    return left <= other.right && other.left <= right && bottom <= other.top && other.bottom <= top;
+}
+
+bool QGeoMapItemSpatialIndex::Box::contains(const Box &other) const
+{
+    return left <= other.left && other.right <= right && bottom <= other.bottom && other.top <= top;
+}
+
+QGeoMapItemSpatialIndex::Box QGeoMapItemSpatialIndex::Box::united(const Box &other) const
+{
+    if (!valid)
+        return other;
+    Box box;
+    box.left = qMin(left, other.left);
+    box.bottom = qMin(bottom, other.bottom);
+    box.right = qMax(right, other.right);
+    box.top = qMax(top, other.top);
+    box.valid = true;
+    return box;
+}
+
+QGeoMapItemSpatialIndex::Box QGeoMapItemSpatialIndex::Box::translated(double dx) const
+{
+    Box box = *this;
+    box.left += dx;
+    box.right += dx;
+    return box;
+}
+
+QGeoMapItemSpatialIndex::Box QGeoMapItemSpatialIndex::Node::bounds() const
+{
+    Box box;
+    for (const Entry &entry : entries)
+        box = box.united(entry.box);
+    return box;
+}
+
+QGeoMapItemSpatialIndex::QGeoMapItemSpatialIndex()
+{
+}
+
+QGeoMapItemSpatialIndex::~QGeoMapItemSpatialIndex()
+{
+    clear();
+}
+
+/*!
+    \internal
+    Inserts \a item with the given geographic \a bounds, or updates its bounds if it is
+    already in the index.
+*/
+void QGeoMapItemSpatialIndex::insert(Item item, const QGeoRectangle &bounds)
+{
+    if (m_bounds.contains(item))
+        remove(item);
+
+    const Box box = Box::fromRectangle(bounds);
+    m_bounds.insert(item, box);
+    if (!box.valid) {
+        m_unbounded.append(item);
+        return;
+    }
+    insertEntry(Entry{box, nullptr, item});
+}
+
+/*!
+    \internal
+    Inserts \a items in bulk.  When the batch is at least as large as the index, the tree is
+    rebuilt and packed, else the items are inserted one by one.
+*/
+void QGeoMapItemSpatialIndex::insert(const QList<QPair<Item, QGeoRectangle> > &items)
+{
+    if (items.size() < count()) {
+        for (const auto &item : items)
+            insert(item.first, item.second);
+        return;
+    }
+
+    // the last bounds of each item win, the lookup replaces a search per item
+    QHash<Item, Box> boxes;
+    boxes.reserve(items.size());
+    bool moved = false;
+    for (const auto &item : items) {
+        boxes.insert(item.first, Box::fromRectangle(item.second));
+        moved = moved || m_bounds.contains(item.first);
+    }
+
+    QVector<Entry> entries;
+    entries.reserve(count() + items.size());
+    collectLeafEntries(m_root, entries);
+    deleteNode(m_root);
+    m_root = nullptr;
+
+    if (moved) { // drop the former entries in one pass
+        const auto isMoved = [&boxes](Item item) { return boxes.contains(item); };
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&isMoved](const Entry &entry) { return isMoved(entry.item); }),
+                      entries.end());
+        m_unbounded.erase(std::remove_if(m_unbounded.begin(), m_unbounded.end(), isMoved),
+                          m_unbounded.end());
+    }
+
+    for (const auto &item : items) {
+        auto it = boxes.find(item.first);
+        if (it == boxes.end())
+            continue; // already inserted
+        const Box box = *it;
+        boxes.erase(it);
+        m_bounds.insert(item.first, box);
+        if (box.valid)
+            entries.append(Entry{box, nullptr, item.first});
+        else
+            m_unbounded.append(item.first);
+    }
+
+    bulkLoad(entries);
+}
+
+/*!
+    \internal
+    Updates the bounds of \a item, returns true if they changed.
+*/
+bool QGeoMapItemSpatialIndex::update(Item item, const QGeoRectangle &bounds)
+{
+    auto it = m_bounds.constFind(item);
+    if (it != m_bounds.constEnd() && *it == Box::fromRectangle(bounds))
+        return false;
+    insert(item, bounds);
+    return true;
+}
+
+bool QGeoMapItemSpatialIndex::remove(Item item)
+{
+    auto it = m_bounds.find(item);
+    if (it == m_bounds.end())
+        return false;
+    const Box box = *it;
+    m_bounds.erase(it);
+
+    if (!box.valid) {
+        m_unbounded.removeOne(item);
+        return true;
+    }
+
+    // the entries of the nodes which underflow are inserted again
+    QVector<Entry> orphans;
+    removeEntry(m_root, item, box, orphans);
+    while (!m_root->leaf && m_root->entries.size() == 1) {
+        Node *child = m_root->entries.at(0).child;
+        delete m_root;
+        m_root = child;
+    }
+    for (const Entry &orphan : qAsConst(orphans))
+        insertEntry(orphan);
+    return true;
+}
+
+void QGeoMapItemSpatialIndex::clear()
+{
+    deleteNode(m_root);
+    m_root = nullptr;
+    m_bounds.clear();
+    m_unbounded.clear();
+}
+
+/*!
+    \internal
+    Returns the items whose bounds intersect \a region, and the items without bounds.
+*/
+QVector<QGeoMapItemSpatialIndex::Item> QGeoMapItemSpatialIndex::query(const QGeoRectangle &region) const
+{
+    QVector<Item> items = m_unbounded;
+    const Box box = Box::fromRectangle(region);
+    if (!m_root || !box.valid)
+        return items;
+
+    const int unboundedCount = items.size();
+    query(m_root, box, items);
+    // across the dateline
+    query(m_root, box.translated(-360.0), items);
+    query(m_root, box.translated(360.0), items);
+    // an item can be found on both sides of the dateline
+    std::sort(items.begin() + unboundedCount, items.end());
+    items.erase(std::unique(items.begin() + unboundedCount, items.end()), items.end());
+    return items;
+}
+
+void QGeoMapItemSpatialIndex::query(const Node *node, const Box &box, QVector<Item> &items) const
+{
+    for (const Entry &entry : node->entries) {
+        if (!entry.box.intersects(box))
+            continue;
+        if (node->leaf)
+            items.append(entry.item);
+        else
+            query(entry.child, box, items);
+    }
+}
+
+void QGeoMapItemSpatialIndex::insertEntry(const Entry &entry)
+{
+    if (!m_root)
+        m_root = new Node;
+    Node *sibling = insertEntry(m_root, entry);
+    if (sibling) { // grow the tree
+        Node *root = new Node;
+        root->leaf = false;
+        root->entries.append(Entry{m_root->bounds(), m_root, nullptr});
+        root->entries.append(Entry{sibling->bounds(), sibling, nullptr});
+        m_root = root;
+    }
+}
+
+// Returns the new sibling of node if it was split
+QGeoMapItemSpatialIndex::Node *QGeoMapItemSpatialIndex::insertEntry(Node *node, const Entry &entry)
+{
+    if (node->leaf) {
+        node->entries.append(entry);
+    } else {
+        // choose the subtree which needs the least enlargement, then the smallest
+        int best = 0;
+        double bestEnlargement = qInf();
+        double bestArea = qInf();
+        for (int i = 0; i < node->entries.size(); ++i) {
+            const Box &box = node->entries.at(i).box;
+            const double area = box.area();
+            const double enlargement = box.united(entry.box).area() - area;
+            if (enlargement < bestEnlargement || (enlargement == bestEnlargement && area < bestArea)) {
+                best = i;
+                bestEnlargement = enlargement;
+                bestArea = area;
+            }
+        }
+        Node *child = node->entries.at(best).child;
+        Node *sibling = insertEntry(child, entry);
+        node->entries[best].box = child->bounds();
+        if (sibling)
+            node->entries.append(Entry{sibling->bounds(), sibling, nullptr});
+    }
+
+    if (node->entries.size() > MaximumEntries)
+        return split(node);
+    return nullptr;
+}
+
+// Splits the entries in two halves along the longest axis of the node
+QGeoMapItemSpatialIndex::Node *QGeoMapItemSpatialIndex::split(Node *node)
+{
+    const Box bounds = node->bounds();
+    if (bounds.right - bounds.left >= bounds.top - bounds.bottom)
+        std::sort(node->entries.begin(), node->entries.end(),
+                  [](const Entry &a, const Entry &b) { return a.box.centerX() < b.box.centerX(); });
+    else
+        std::sort(node->entries.begin(), node->entries.end(),
+                  [](const Entry &a, const Entry &b) { return a.box.centerY() < b.box.centerY(); });
+
+    Node *sibling = new Node;
+    sibling->leaf = node->leaf;
+    const int half = node->entries.size() / 2;
+    for (int i = half; i < node->entries.size(); ++i)
+        sibling->entries.append(node->entries.at(i));
+    node->entries.resize(half);
+    return sibling;
+}
+
+bool QGeoMapItemSpatialIndex::removeEntry(Node *node, Item item, const Box &box, QVector<Entry> &orphans)
+{
+    if (node->leaf) {
+        for (int i = 0; i < node->entries.size(); ++i) {
+            if (node->entries.at(i).item == item) {
+                node->entries.remove(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (int i = 0; i < node->entries.size(); ++i) {
+        Entry &entry = node->entries[i];
+        if (!entry.box.contains(box) || !removeEntry(entry.child, item, box, orphans))
+            continue;
+        if (entry.child->entries.size() < MinimumEntries) {
+            collectLeafEntries(entry.child, orphans);
+            deleteNode(entry.child);
+            node->entries.remove(i);
+        } else {
+            entry.box = entry.child->bounds();
+        }
+        return true;
+    }
+    return false;
+}
+
+void QGeoMapItemSpatialIndex::bulkLoad(QVector<Entry> &entries)
+{
+    if (entries.isEmpty())
+        return;
+    QVector<Entry> level = pack(entries, true);
+    while (level.size() > 1)
+        level = pack(level, false);
+    m_root = level.at(0).child;
+}
+
+// Sort-Tile-Recursive packing of one level, returns the entries of the parent level
+QVector<QGeoMapItemSpatialIndex::Entry> QGeoMapItemSpatialIndex::pack(QVector<Entry> &entries, bool leaf)
+{
+    const int numberOfNodes = (entries.size() + MaximumEntries - 1) / MaximumEntries;
+    const int numberOfSlices = int(std::ceil(std::sqrt(double(numberOfNodes))));
+    const int sliceSize = numberOfSlices * MaximumEntries;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.box.centerX() < b.box.centerX(); });
+
+    QVector<Entry> parents;
+    parents.reserve(numberOfNodes);
+    for (int slice = 0; slice < entries.size(); slice += sliceSize) {
+        const auto sliceEnd = entries.begin() + qMin(slice + sliceSize, entries.size());
+        std::sort(entries.begin() + slice, sliceEnd,
+                  [](const Entry &a, const Entry &b) { return a.box.centerY() < b.box.centerY(); });
+        for (auto it = entries.begin() + slice; it < sliceEnd; it += qMin<int>(MaximumEntries, sliceEnd - it)) {
+            Node *node = new Node;
+            node->leaf = leaf;
+            for (auto entry = it; entry < sliceEnd && entry < it + MaximumEntries; ++entry)
+                node->entries.append(*entry);
+            parents.append(Entry{node->bounds(), node, nullptr});
+        }
+    }
+    return parents;
+}
+
+void QGeoMapItemSpatialIndex::collectLeafEntries(const Node *node, QVector<Entry> &entries)
+{
+    if (!node)
+        return;
+    if (node->leaf) {
+        for (const Entry &entry : node->entries)
+            entries.append(entry);
+        return;
+    }
+    for (const Entry &entry : node->entries)
+        collectLeafEntries(entry.child, entries);
+}
+
+void QGeoMapItemSpatialIndex::deleteNode(Node *node)
+{
+    if (!node)
+        return;
+    if (!node->leaf) {
+        for (const Entry &entry : node->entries)
+            deleteNode(entry.child);
+    }
+    delete node;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtLocation module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+/*
+    Benchmark of the spatial index of the map items with 1k, 10k and 100k items.
+
+    For each size, measures the bulk and the one by one insertions, the update of the bounds
+    of 1% of the items, as syncMapItemsToCamera() does for the items which moved, and the
+    query of a viewport, which is compared to the linear scan it replaces.
+*/
+
+#include "qgeomapitemspatialindex_p.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QTextStream>
+#include <QtPositioning/QGeoRectangle>
+#include <QtPositioning/private/qlocationutils_p.h>
+#include <vector>
+
+QT_USE_NAMESPACE
+
+typedef QGeoMapItemSpatialIndex::Item Item;
+
+static QGeoRectangle randomRectangle(QRandomGenerator &generator)
+{
+    // items up to a city in size, some of them across the dateline
+    const double width = generator.bounded(0.5);
+    const double height = generator.bounded(0.5);
+    const double left = generator.bounded(360.0) - 180.0;
+    const double top = generator.bounded(170.0 - height) - 85.0 + height;
+    return QGeoRectangle(QGeoCoordinate(top, left),
+                         QGeoCoordinate(top - height, QLocationUtils::wrapLong(left + width)));
+}
+
+static double elapsedMilliseconds(const QElapsedTimer &timer)
+{
+    return timer.nsecsElapsed() / 1e6;
+}
+
+static bool benchmark(int numberOfItems, QTextStream &out)
+{
+    QRandomGenerator generator(numberOfItems);
+
+    // the index never dereferences the items, thus any distinct addresses will do
+    std::vector<char> storage(numberOfItems);
+    QList<QPair<Item, QGeoRectangle> > items;
+    items.reserve(numberOfItems);
+    for (int i = 0; i < numberOfItems; ++i)
+        items.append(qMakePair(reinterpret_cast<Item>(&storage[i]), randomRectangle(generator)));
+
+    QElapsedTimer timer;
+    QGeoMapItemSpatialIndex index;
+    timer.start();
+    index.insert(items);
+    const double bulkInsertTime = elapsedMilliseconds(timer);
+
+    QGeoMapItemSpatialIndex dynamicIndex;
+    timer.start();
+    for (const auto &item : qAsConst(items))
+        dynamicIndex.insert(item.first, item.second);
+    const double insertTime = elapsedMilliseconds(timer);
+
+    const int numberOfUpdates = qMax(numberOfItems / 100, 1);
+    timer.start();
+    for (int i = 0; i < numberOfUpdates; ++i) {
+        auto &item = items[generator.bounded(numberOfItems)];
+        item.second = randomRectangle(generator);
+        index.update(item.first, item.second);
+    }
+    const double updateTime = elapsedMilliseconds(timer);
+
+    // a viewport at street level, expanded as in syncMapItemsToCamera()
+    const int numberOfQueries = 1000;
+    QVector<QGeoRectangle> regions;
+    regions.reserve(numberOfQueries);
+    for (int i = 0; i < numberOfQueries; ++i) {
+        const QGeoCoordinate center(generator.bounded(160.0) - 80.0, generator.bounded(360.0) - 180.0);
+        regions.append(QGeoRectangle(center, 4.0, 2.0));
+    }
+
+    qint64 indexCount = 0;
+    timer.start();
+    for (const QGeoRectangle &region : qAsConst(regions))
+        indexCount += index.query(region).size();
+    const double queryTime = elapsedMilliseconds(timer) / numberOfQueries;
+
+    qint64 linearCount = 0;
+    timer.start();
+    for (const QGeoRectangle &region : qAsConst(regions)) {
+        for (const auto &item : qAsConst(items))
+            linearCount += region.intersects(item.second);
+    }
+    const double linearTime = elapsedMilliseconds(timer) / numberOfQueries;
+
+    out << numberOfItems << " items: bulk insert " << bulkInsertTime << " ms, insert "
+        << insertTime << " ms, " << numberOfUpdates << " updates " << updateTime << " ms, query "
+        << queryTime * 1000 << " us (linear scan " << linearTime * 1000 << " us, "
+        << double(indexCount) / numberOfQueries << " items per query)" << Qt::endl;
+
+    if (indexCount != linearCount) {
+        out << "the index found " << indexCount << " items, the linear scan " << linearCount << Qt::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QTextStream out(stdout);
+
+    bool ok = true;
+    for (int numberOfItems : {1000, 10000, 100000})
+        ok = benchmark(numberOfItems, out) && ok;
+    return ok ? 0 : 1;
+}
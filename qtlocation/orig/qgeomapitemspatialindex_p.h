@@ -0,0 +1,152 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtLocation module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QGEOMAPITEMSPATIALINDEX_P_H
+#define QGEOMAPITEMSPATIALINDEX_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtLocation/private/qlocationglobal_p.h>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QVector>
+#include <QtPositioning/qgeorectangle.h>
+
+QT_BEGIN_NAMESPACE
+
+class QDeclarativeGeoMapItemBase;
+
+/*
+    R-tree of the geographic bounds of the map items.
+
+    The bounds are stored in degrees, a rectangle crossing the dateline is stored with a right
+    longitude above 180 and the queries are repeated across the dateline.  Items without valid
+    bounds are returned by all the queries.
+
+    The tree is dynamic for the edits, and it is packed with the Sort-Tile-Recursive algorithm
+    when items are inserted in bulk.
+*/
+class Q_LOCATION_PRIVATE_EXPORT QGeoMapItemSpatialIndex
+{
+public:
+    typedef QDeclarativeGeoMapItemBase *Item;
+
+    QGeoMapItemSpatialIndex();
+    ~QGeoMapItemSpatialIndex();
+
+    int count() const { return m_bounds.size(); }
+    bool isEmpty() const { return m_bounds.isEmpty(); }
+    bool contains(Item item) const { return m_bounds.contains(item); }
+
+    void insert(Item item, const QGeoRectangle &bounds);
+    void insert(const QList<QPair<Item, QGeoRectangle> > &items);
+    bool update(Item item, const QGeoRectangle &bounds);
+    bool remove(Item item);
+    void clear();
+
+    QVector<Item> query(const QGeoRectangle &region) const;
+
+private:
+    static constexpr int MaximumEntries = 16;
+    static constexpr int MinimumEntries = 4;
+
+    struct Box
+    {
+        double left = 0;
+        double bottom = 0;
+        double right = 0;
+        double top = 0;
+        bool valid = false;
+
+        static Box fromRectangle(const QGeoRectangle &rectangle);
+        bool operator==(const Box &other) const;
+        bool intersects(const Box &other) const;
+        bool contains(const Box &other) const;
+        Box united(const Box &other) const;
+        Box translated(double dx) const;
+        double area() const { return (right - left) * (top - bottom); }
+        double centerX() const { return (left + right) / 2; }
+        double centerY() const { return (bottom + top) / 2; }
+    };
+
+    struct Node;
+
+    struct Entry
+    {
+        Box box;
+        Node *child; // inner nodes
+        Item item; // leaves
+    };
+
+    struct Node
+    {
+        bool leaf = true;
+        QVarLengthArray<Entry, MaximumEntries + 1> entries;
+
+        Box bounds() const;
+    };
+
+    void insertEntry(const Entry &entry);
+    Node *insertEntry(Node *node, const Entry &entry);
+    Node *split(Node *node);
+    bool removeEntry(Node *node, Item item, const Box &box, QVector<Entry> &orphans);
+    void query(const Node *node, const Box &box, QVector<Item> &items) const;
+    void bulkLoad(QVector<Entry> &entries);
+    static QVector<Entry> pack(QVector<Entry> &entries, bool leaf);
+    static void collectLeafEntries(const Node *node, QVector<Entry> &entries);
+    static void deleteNode(Node *node);
+
+    Node *m_root = nullptr;
+    QHash<Item, Box> m_bounds;
+    QVector<Item> m_unbounded; // items without valid bounds
+
+    Q_DISABLE_COPY(QGeoMapItemSpatialIndex)
+};
+
+QT_END_NAMESPACE
+
+#endif // QGEOMAPITEMSPATIALINDEX_P_H
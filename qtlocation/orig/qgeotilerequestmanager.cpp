@@ -0,0 +1,251 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the QtLocation module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL3$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 3 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPLv3 included in the
+** packaging of this file. Please review the following information to
+** ensure the GNU Lesser General Public License version 3 requirements
+** will be met: https://www.gnu.org/licenses/lgpl.html.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 2.0 or later as published by the Free
+** Software Foundation and appearing in the file LICENSE.GPL included in
+** the packaging of this file. Please review the following information to
+** ensure the GNU General Public License version 2.0 requirements will be
+** met: http://www.gnu.org/licenses/gpl-2.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "qgeotilerequestmanager_p.h"
+#include "qgeotilespec_p.h"
+#include "qgeotiledmap_p.h"
+#include "qgeotiledmappingmanagerengine_p.h"
+#include "qgeotilecache_p.h"
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+
+QT_BEGIN_NAMESPACE
+
+QGeoTileRequestManager::QGeoTileRequestManager(QGeoTiledMap *map, QGeoTiledMappingManagerEngine *engine)
+    : d_ptr(new QGeoTileRequestManagerPrivate(map, engine))
+{
+
+}
+
+QGeoTileRequestManager::~QGeoTileRequestManager()
+{
+
+}
+
+/*
+    Requests the visible \a tiles and returns the textures of those which are in the cache.
+
+    The tiles of the previous call which are no longer visible are cancelled, unless they are
+    prefetched.
+*/
+QMap<QGeoTileSpec, QSharedPointer<QGeoTileTexture> > QGeoTileRequestManager::requestTiles(const QSet<QGeoTileSpec> &tiles)
+{
+    Q_D(QGeoTileRequestManager);
+    d->m_visible = tiles;
+    return d->updateRequests();
+}
+
+/*
+    Requests the \a tiles loaded in the background, e.g. along the camera path of a gesture.
+
+    They are requested with the visible tiles, thus the requests of the map don't cancel them,
+    and they are dropped once they are fetched.  Only the tiles which were not prefetched yet
+    are sent to the fetcher, in one call, so that the tiles which are added segment by segment
+    are fetched in that order.
+*/
+void QGeoTileRequestManager::setPrefetchTiles(const QSet<QGeoTileSpec> &tiles)
+{
+    Q_D(QGeoTileRequestManager);
+    if (tiles == d->m_prefetch)
+        return;
+    d->m_prefetch = tiles;
+    d->updateRequests();
+}
+
+QSet<QGeoTileSpec> QGeoTileRequestManager::prefetchTiles() const
+{
+    Q_D(const QGeoTileRequestManager);
+    return d->m_prefetch;
+}
+
+void QGeoTileRequestManager::tileFetched(const QGeoTileSpec &spec)
+{
+    Q_D(QGeoTileRequestManager);
+    d->tileFetched(spec);
+}
+
+QSharedPointer<QGeoTileTexture> QGeoTileRequestManager::tileTexture(const QGeoTileSpec &spec)
+{
+    Q_D(QGeoTileRequestManager);
+    if (d->m_engine)
+        return d->m_engine->getTileTexture(spec);
+    else
+        return QSharedPointer<QGeoTileTexture>();
+}
+
+/*!
+    Returns the tile version of the engine, -1 if the engine is gone.
+*/
+int QGeoTileRequestManager::tileVersion() const
+{
+    Q_D(const QGeoTileRequestManager);
+    if (d->m_engine)
+        return d->m_engine->tileVersion();
+    else
+        return -1;
+}
+
+void QGeoTileRequestManager::tileError(const QGeoTileSpec &tile, const QString &errorString)
+{
+    Q_D(QGeoTileRequestManager);
+    d->tileError(tile, errorString);
+}
+
+QGeoTileRequestManagerPrivate::QGeoTileRequestManagerPrivate(QGeoTiledMap *map,QGeoTiledMappingManagerEngine *engine)
+    : m_map(map),
+      m_engine(engine)
+{
+}
+
+QGeoTileRequestManagerPrivate::~QGeoTileRequestManagerPrivate()
+{
+}
+
+QMap<QGeoTileSpec, QSharedPointer<QGeoTileTexture> > QGeoTileRequestManagerPrivate::updateRequests()
+{
+    // the visible and the prefetched tiles are requested together
+    const QSet<QGeoTileSpec> tiles = m_visible + m_prefetch;
+    QSet<QGeoTileSpec> cancelTiles = m_requested - tiles;
+    QSet<QGeoTileSpec> requestTiles = tiles - m_requested;
+    QSet<QGeoTileSpec> cached;
+
+    QMap<QGeoTileSpec, QSharedPointer<QGeoTileTexture> > cachedTex;
+
+    // remove tiles in cache from request tiles
+    if (!m_engine.isNull()) {
+        for (const auto &tile : qAsConst(requestTiles)) {
+            QSharedPointer<QGeoTileTexture> tex = m_engine->getTileTexture(tile);
+            if (tex) {
+                if (!tex->image.isNull() && m_visible.contains(tile))
+                    cachedTex.insert(tile, tex);
+                cached.insert(tile);
+            } else if (m_visible.contains(tile)) {
+                // Try to use textures from lower zoom levels, but still request the proper tile
+                QGeoTileSpec spec = tile;
+                const int endRange = qMax(0, tile.zoom() - 4); // Using up to 4 zoom levels up. 4 is arbitrary.
+                for (int z = tile.zoom() - 1; z >= endRange; z--) {
+                    int x = spec.x() / 2;
+                    int y = spec.y() / 2;
+                    spec.setZoom(z);
+                    spec.setX(x);
+                    spec.setY(y);
+                    QSharedPointer<QGeoTileTexture> t = m_engine->getTileTexture(spec);
+                    if (t && !t->image.isNull()) {
+                        cachedTex.insert(tile, t);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    requestTiles -= cached;
+    // a prefetched tile in the cache is done
+    m_prefetch -= cached;
+
+    m_requested -= cancelTiles;
+    m_requested += requestTiles;
+
+    if (!requestTiles.isEmpty() || !cancelTiles.isEmpty()) {
+        if (!m_engine.isNull()) {
+            m_engine->updateTileRequests(m_map, requestTiles, cancelTiles);
+
+            // Remove any cancelled tiles from the error retry hash to avoid
+            // re-using the numbers for a totally different request cycle.
+            for (const auto &tile : qAsConst(cancelTiles)) {
+                m_retries.remove(tile);
+                m_futures.remove(tile);
+            }
+        }
+    }
+
+    return cachedTex;
+}
+
+void QGeoTileRequestManagerPrivate::tileFetched(const QGeoTileSpec &spec)
+{
+    m_map->updateTile(spec);
+    m_requested.remove(spec);
+    m_prefetch.remove(spec);
+    m_retries.remove(spec);
+    m_futures.remove(spec);
+}
+
+// Represents a tile that needs to be retried after a certain period of time
+RetryFuture::RetryFuture(const QGeoTileSpec &tile, QGeoTiledMap *map, QGeoTiledMappingManagerEngine *engine, QObject *parent)
+    : QObject(parent), m_tile(tile), m_map(map), m_engine(engine)
+{}
+
+void RetryFuture::retry()
+{
+    QSet<QGeoTileSpec> requestTiles;
+    QSet<QGeoTileSpec> cancelTiles;
+    requestTiles.insert(m_tile);
+    if (!m_engine.isNull())
+        m_engine->updateTileRequests(m_map, requestTiles, cancelTiles);
+}
+
+void QGeoTileRequestManagerPrivate::tileError(const QGeoTileSpec &tile, const QString &errorString)
+{
+    if (m_requested.contains(tile)) {
+        int count = m_retries.value(tile, 0);
+        m_retries.insert(tile, count + 1);
+
+        if (count >= 5) {
+            qWarning("QGeoTileRequestManager: Failed to fetch tile (%d,%d,%d) 5 times, giving up. "
+                     "Last error message was: '%s'",
+                     tile.x(), tile.y(), tile.zoom(), qPrintable(errorString));
+            m_requested.remove(tile);
+            m_prefetch.remove(tile);
+            m_retries.remove(tile);
+            m_futures.remove(tile);
+
+        } else {
+            // Exponential time backoff when retrying
+            int delay = (1 << count) * 500;
+
+            QSharedPointer<RetryFuture> future(new RetryFuture(tile,m_map,m_engine));
+            m_futures.insert(tile, future);
+
+            QTimer::singleShot(delay, future.data(), &RetryFuture::retry);
+            // Passing .data() to singleShot is ok -- Qt will clean up the
+            // connection if the target qobject is deleted
+        }
+    }
+}
+
+QT_END_NAMESPACE